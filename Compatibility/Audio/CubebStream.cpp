@@ -14,6 +14,8 @@
 #include "Common/Thread.h"
 #include "Core/ConfigManager.h"
 
+#include "FrameDump.h"
+
 // ~10 ms - needs to be at least 240 for surround
 constexpr u32 BUFFER_SAMPLES = 512;
 
@@ -26,6 +28,8 @@ long CubebStream::DataCallback(cubeb_stream* stream, void* user_data, const void
     {
         self->m_mixer->Mix(static_cast<short*>(output_buffer), num_frames);
         [[_current ringBufferAtIndex:0] write:(const uint8_t *)output_buffer maxLength:num_frames * 4]; //FRAME_STEREO_SHORT];
+        FrameDump::SubmitAudio(static_cast<const short*>(output_buffer), num_frames,
+                               self->m_mixer->GetSampleRate());
     }
     else
     {
@@ -0,0 +1,28 @@
+// Copyright 2018 Dolphin Emulator Project
+// Licensed under GPLv2+
+// Refer to the license.txt file included.
+
+// GetHash64 goes to TextureHash. Upstream only has its SSE4.2 CRC32 path with -msse4.2, which
+// we don't build with, so the texture cache was running the scalar Murmur3 fallback. The rest
+// of the file, including the functions picked before, is upstream's unchanged.
+
+#include "Common/Hash.h"
+
+#include "TextureHash.h"
+
+#define GetHash64 UpstreamGetHash64
+#define SetHash64Function UpstreamSetHash64Function
+#include "../../dolphin/Source/Core/Common/Hash.cpp"
+#undef GetHash64
+#undef SetHash64Function
+
+u64 GetHash64(const u8* src, u32 len, u32 samples)
+{
+  return TextureHash::Hash64(src, len, samples);
+}
+
+void SetHash64Function()
+{
+  UpstreamSetHash64Function();
+  TextureHash::Init();
+}
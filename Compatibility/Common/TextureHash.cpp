@@ -0,0 +1,357 @@
+// Copyright 2018 Dolphin Emulator Project
+// Licensed under GPLv2+
+// Refer to the license.txt file included.
+
+#include "TextureHash.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Common/CPUDetect.h"
+#include "Common/Hash.h"
+#include "Common/Logging/Log.h"
+#include "Common/StringUtil.h"
+#include "Common/Timer.h"
+
+#if defined(_M_X86_64)
+#include <immintrin.h>
+#elif defined(_M_ARM_64)
+#include <arm_neon.h>
+#endif
+
+namespace TextureHash
+{
+static constexpr u32 STRIPE_SIZE = 32;
+static constexpr u32 WORDS_PER_STRIPE = STRIPE_SIZE / sizeof(u64);
+
+static constexpr u64 PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static constexpr u64 PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr u64 PRIME64_3 = 0x165667B19E3779F9ULL;
+// Added to every lane's key after each stripe, so reordering stripes changes the hash.
+static constexpr u64 KEY_STEP = PRIME64_1;
+alignas(32) static const u64 KEY[WORDS_PER_STRIPE] = {
+    0xbe4ba423396cfeb8ULL, 0x1cad21f72c81017cULL, 0xdb979083e96dd4deULL, 0x1f67b3b7a4a44072ULL};
+
+// Accumulates stripes 0, step, 2 * step, ... below stripes.
+using AccumulateFunction = void (*)(u64* acc, const u8* data, u32 stripes, u32 step);
+
+static void AccumulateStripe(u64* acc, const u8* stripe, u64 key_offset)
+{
+  u64 words[WORDS_PER_STRIPE];
+  std::memcpy(words, stripe, STRIPE_SIZE);
+  for (u32 lane = 0; lane < WORDS_PER_STRIPE; ++lane)
+  {
+    const u64 keyed = words[lane] ^ (KEY[lane] + key_offset);
+    acc[lane] += (keyed & 0xFFFFFFFF) * (keyed >> 32);
+    acc[lane] += words[lane ^ 1];
+  }
+}
+
+static void AccumulateScalar(u64* acc, const u8* data, u32 stripes, u32 step)
+{
+  for (u32 stripe = 0; stripe < stripes; stripe += step)
+    AccumulateStripe(acc, data + stripe * STRIPE_SIZE, stripe * KEY_STEP);
+}
+
+#if defined(_M_X86_64)
+static void AccumulateSSE2(u64* acc, const u8* data, u32 stripes, u32 step)
+{
+  __m128i acc0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc));
+  __m128i acc1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + 2));
+  __m128i key0 = _mm_load_si128(reinterpret_cast<const __m128i*>(KEY));
+  __m128i key1 = _mm_load_si128(reinterpret_cast<const __m128i*>(KEY + 2));
+  const __m128i key_step = _mm_set1_epi64x(static_cast<s64>(KEY_STEP * step));
+
+  for (u32 stripe = 0; stripe < stripes; stripe += step)
+  {
+    const u8* ptr = data + stripe * STRIPE_SIZE;
+    const __m128i data0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr));
+    const __m128i data1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ptr + 16));
+    const __m128i keyed0 = _mm_xor_si128(data0, key0);
+    const __m128i keyed1 = _mm_xor_si128(data1, key1);
+    acc0 = _mm_add_epi64(acc0, _mm_mul_epu32(keyed0, _mm_srli_epi64(keyed0, 32)));
+    acc1 = _mm_add_epi64(acc1, _mm_mul_epu32(keyed1, _mm_srli_epi64(keyed1, 32)));
+    acc0 = _mm_add_epi64(acc0, _mm_shuffle_epi32(data0, _MM_SHUFFLE(1, 0, 3, 2)));
+    acc1 = _mm_add_epi64(acc1, _mm_shuffle_epi32(data1, _MM_SHUFFLE(1, 0, 3, 2)));
+    key0 = _mm_add_epi64(key0, key_step);
+    key1 = _mm_add_epi64(key1, key_step);
+  }
+
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(acc), acc0);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(acc + 2), acc1);
+}
+
+// The build targets SSE2, AVX2 is enabled for this function alone and only called when the CPU
+// and OS support it.
+__attribute__((target("avx2"))) static void AccumulateAVX2(u64* acc, const u8* data, u32 stripes,
+                                                            u32 step)
+{
+  __m256i acc0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc));
+  __m256i key0 = _mm256_load_si256(reinterpret_cast<const __m256i*>(KEY));
+  const __m256i key_step = _mm256_set1_epi64x(static_cast<s64>(KEY_STEP * step));
+
+  for (u32 stripe = 0; stripe < stripes; stripe += step)
+  {
+    const __m256i data0 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + stripe * STRIPE_SIZE));
+    const __m256i keyed0 = _mm256_xor_si256(data0, key0);
+    acc0 = _mm256_add_epi64(acc0, _mm256_mul_epu32(keyed0, _mm256_srli_epi64(keyed0, 32)));
+    acc0 = _mm256_add_epi64(acc0, _mm256_shuffle_epi32(data0, _MM_SHUFFLE(1, 0, 3, 2)));
+    key0 = _mm256_add_epi64(key0, key_step);
+  }
+
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(acc), acc0);
+}
+#elif defined(_M_ARM_64)
+static void AccumulateNEON(u64* acc, const u8* data, u32 stripes, u32 step)
+{
+  uint64x2_t acc0 = vld1q_u64(acc);
+  uint64x2_t acc1 = vld1q_u64(acc + 2);
+  uint64x2_t key0 = vld1q_u64(KEY);
+  uint64x2_t key1 = vld1q_u64(KEY + 2);
+  const uint64x2_t key_step = vdupq_n_u64(KEY_STEP * step);
+
+  for (u32 stripe = 0; stripe < stripes; stripe += step)
+  {
+    const u64* ptr = reinterpret_cast<const u64*>(data + stripe * STRIPE_SIZE);
+    const uint64x2_t data0 = vld1q_u64(ptr);
+    const uint64x2_t data1 = vld1q_u64(ptr + 2);
+    const uint64x2_t keyed0 = veorq_u64(data0, key0);
+    const uint64x2_t keyed1 = veorq_u64(data1, key1);
+    acc0 = vmlal_u32(acc0, vmovn_u64(keyed0), vshrn_n_u64(keyed0, 32));
+    acc1 = vmlal_u32(acc1, vmovn_u64(keyed1), vshrn_n_u64(keyed1, 32));
+    acc0 = vaddq_u64(acc0, vextq_u64(data0, data0, 1));
+    acc1 = vaddq_u64(acc1, vextq_u64(data1, data1, 1));
+    key0 = vaddq_u64(key0, key_step);
+    key1 = vaddq_u64(key1, key_step);
+  }
+
+  vst1q_u64(acc, acc0);
+  vst1q_u64(acc + 2, acc1);
+}
+#endif
+
+struct Implementation
+{
+  const char* name;
+  AccumulateFunction accumulate;
+};
+
+static Implementation s_implementation = {"scalar", AccumulateScalar};
+
+static u64 Mix64(u64 k)
+{
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  k ^= k >> 33;
+  return k;
+}
+
+static u64 HashWith(AccumulateFunction accumulate, const u8* src, u32 len, u32 samples)
+{
+  const u32 stripes = len / STRIPE_SIZE;
+  u32 step = 1;
+  if (samples != 0)
+    step = std::max(stripes / std::max(samples / WORDS_PER_STRIPE, 1u), 1u);
+
+  u64 acc[WORDS_PER_STRIPE] = {PRIME64_1, PRIME64_2, PRIME64_3, len};
+  if (stripes)
+    accumulate(acc, src, stripes, step);
+
+  if (len % STRIPE_SIZE)
+  {
+    u8 tail[STRIPE_SIZE] = {};
+    std::memcpy(tail, src + stripes * STRIPE_SIZE, len % STRIPE_SIZE);
+    AccumulateStripe(acc, tail, stripes * KEY_STEP);
+  }
+
+  u64 hash = len * PRIME64_1;
+  for (u32 lane = 0; lane < WORDS_PER_STRIPE; ++lane)
+  {
+    hash ^= Mix64(acc[lane] + KEY[lane]);
+    hash = ((hash << 27) | (hash >> 37)) * PRIME64_1 + PRIME64_2;
+  }
+  return Mix64(hash);
+}
+
+#if defined(_DEBUG)
+static constexpr size_t MAX_VERIFY_ENTRIES = 1 << 20;
+
+struct VerifyEntry
+{
+  u64 previous_hash;
+  u32 len;
+};
+
+static std::atomic<bool> s_verify{false};
+static std::mutex s_verify_mutex;
+static std::unordered_map<u64, VerifyEntry> s_verify_hashes;
+static std::unordered_map<u64, u64> s_verify_previous_hashes;
+static u64 s_verified = 0;
+
+// Works on full hashes, sampling would miss differences on purpose.
+static void Verify(const u8* src, u32 len)
+{
+  const u64 hash = HashWith(s_implementation.accumulate, src, len, 0);
+  const u64 previous_hash = GetMurmurHash3(src, len, 0);
+
+  std::lock_guard<std::mutex> lock(s_verify_mutex);
+  if (s_verify_hashes.size() >= MAX_VERIFY_ENTRIES)
+  {
+    s_verify_hashes.clear();
+    s_verify_previous_hashes.clear();
+  }
+
+  auto it = s_verify_hashes.emplace(hash, VerifyEntry{previous_hash, len}).first;
+  if (it->second.previous_hash != previous_hash)
+  {
+    ERROR_LOG(VIDEO, "Texture hash: collision on %016llx (%u and %u bytes), Murmur3 tells them "
+                     "apart",
+              static_cast<unsigned long long>(hash), it->second.len, len);
+  }
+
+  auto previous = s_verify_previous_hashes.emplace(previous_hash, hash).first;
+  if (previous->second != hash)
+  {
+    WARN_LOG(VIDEO, "Texture hash: Murmur3 collision on %016llx, the new hash tells them apart",
+             static_cast<unsigned long long>(previous_hash));
+  }
+
+  if (++s_verified % 100000 == 0)
+    INFO_LOG(VIDEO, "Texture hash: %llu hashes verified", static_cast<unsigned long long>(s_verified));
+}
+#endif
+
+u64 Hash64(const u8* src, u32 len, u32 samples)
+{
+#if defined(_DEBUG)
+  if (s_verify)
+    Verify(src, len);
+#endif
+
+  return HashWith(s_implementation.accumulate, src, len, samples);
+}
+
+static std::vector<Implementation> AvailableImplementations()
+{
+  std::vector<Implementation> implementations = {{"scalar", AccumulateScalar}};
+#if defined(_M_X86_64)
+  implementations.push_back({"SSE2", AccumulateSSE2});
+  if (cpu_info.bAVX && cpu_info.bAVX2)
+    implementations.push_back({"AVX2", AccumulateAVX2});
+#elif defined(_M_ARM_64)
+  implementations.push_back({"NEON", AccumulateNEON});
+#endif
+  return implementations;
+}
+
+void Init()
+{
+  s_implementation = AvailableImplementations().back();
+  INFO_LOG(VIDEO, "Texture hash: using the %s implementation", s_implementation.name);
+}
+
+const char* GetImplementationName()
+{
+  return s_implementation.name;
+}
+
+void SetVerify(bool enabled)
+{
+#if defined(_DEBUG)
+  if (s_verify == enabled)
+    return;
+
+  std::lock_guard<std::mutex> lock(s_verify_mutex);
+  s_verify = enabled;
+  s_verify_hashes.clear();
+  s_verify_previous_hashes.clear();
+  s_verified = 0;
+#else
+  static bool s_warned = false;
+  if (enabled && !s_warned)
+  {
+    WARN_LOG(VIDEO, "Texture hash: verification is only available in debug builds");
+    s_warned = true;
+  }
+#endif
+}
+
+// Keeps the timed loops from being optimized out.
+static volatile u64 s_benchmark_sink;
+
+void RunBenchmark(u32 samples)
+{
+  // Sizes of the textures and formats games use most, in bytes of guest memory.
+  static const struct
+  {
+    const char* name;
+    u32 size;
+  } cases[] = {
+      {"I4 64x64", 64 * 64 / 2},           {"CMPR 128x128", 128 * 128 / 2},
+      {"RGB5A3 128x128", 128 * 128 * 2},   {"IA8 256x256", 256 * 256 * 2},
+      {"RGBA8 256x256", 256 * 256 * 4},    {"CMPR 1024x1024", 1024 * 1024 / 2},
+      {"RGBA8 640x528 (EFB copy)", 640 * 528 * 4}, {"RGBA8 1024x1024", 1024 * 1024 * 4},
+  };
+  // Every case hashes about this much, so small sizes aren't lost in timer resolution.
+  static constexpr u64 BYTES_PER_CASE = 256 * 1024 * 1024;
+
+  std::vector<u8> data(1024 * 1024 * 4);
+  u64 seed = 0x2545F4914F6CDD1DULL;
+  for (u8& byte : data)
+  {
+    seed ^= seed << 13;
+    seed ^= seed >> 7;
+    seed ^= seed << 17;
+    byte = static_cast<u8>(seed);
+  }
+
+  const std::vector<Implementation> implementations = AvailableImplementations();
+  for (const u32 case_samples : {0u, samples})
+  {
+    NOTICE_LOG(VIDEO, "Texture hash benchmark, %s (GB/s of guest memory):",
+               case_samples ? "sampled" : "full");
+    for (const auto& test : cases)
+    {
+      const u32 iterations = static_cast<u32>(std::max<u64>(BYTES_PER_CASE / test.size, 1));
+      const double gigabytes = static_cast<double>(test.size) * iterations / 1e9;
+      std::string results;
+      u64 expected = 0;
+      for (const Implementation& implementation : implementations)
+      {
+        u64 hash = 0;
+        const u64 start_time = Common::Timer::GetTimeUs();
+        for (u32 i = 0; i < iterations; ++i)
+          hash ^= HashWith(implementation.accumulate, data.data(), test.size, case_samples) + i;
+        const u64 elapsed_us = std::max<u64>(Common::Timer::GetTimeUs() - start_time, 1);
+        s_benchmark_sink = hash;
+        results += StringFromFormat(" %s %.2f", implementation.name, gigabytes / (elapsed_us / 1e6));
+
+        const u64 single = HashWith(implementation.accumulate, data.data(), test.size, case_samples);
+        if (implementation.accumulate == AccumulateScalar)
+          expected = single;
+        else if (single != expected)
+          ERROR_LOG(VIDEO, "Texture hash: %s disagrees with scalar on %s", implementation.name,
+                    test.name);
+      }
+
+      u64 hash = 0;
+      const u64 start_time = Common::Timer::GetTimeUs();
+      for (u32 i = 0; i < iterations; ++i)
+        hash ^= GetMurmurHash3(data.data(), test.size, case_samples) + i;
+      const u64 elapsed_us = std::max<u64>(Common::Timer::GetTimeUs() - start_time, 1);
+      s_benchmark_sink = hash;
+      results += StringFromFormat(" | Murmur3 %.2f", gigabytes / (elapsed_us / 1e6));
+
+      NOTICE_LOG(VIDEO, "  %-26s%s", test.name, results.c_str());
+    }
+  }
+}
+}
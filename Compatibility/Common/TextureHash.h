@@ -0,0 +1,32 @@
+// Copyright 2018 Dolphin Emulator Project
+// Licensed under GPLv2+
+// Refer to the license.txt file included.
+
+// The 64-bit hash behind GetHash64, which the texture cache runs over guest memory for every
+// texture and palette it looks up. Four 64-bit lanes accumulate the product of the halves of
+// each input word mixed with a per-stripe key, the accumulator layout of XXH3. That maps
+// directly onto AVX2, SSE2 and NEON, and every implementation produces the same value as the
+// scalar one, so the fastest available is picked at runtime.
+
+#pragma once
+
+#include "Common/CommonTypes.h"
+
+namespace TextureHash
+{
+// Same contract as GetHash64: samples is the number of 8-byte words to look at, 0 hashes all
+// of src. The last partial 32 bytes are always hashed.
+u64 Hash64(const u8* src, u32 len, u32 samples);
+
+// Picks the implementation for this CPU.
+void Init();
+const char* GetImplementationName();
+
+// Debug builds only: hash everything a second time with Murmur3, the previous hash, and log
+// whenever one of the two collides where the other doesn't.
+void SetVerify(bool enabled);
+
+// Logs the throughput of every available implementation and of Murmur3 over typical texture
+// sizes, hashed in full and sampled, and checks they all agree.
+void RunBenchmark(u32 samples);
+}
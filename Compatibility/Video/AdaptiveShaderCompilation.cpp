@@ -0,0 +1,151 @@
+// Copyright 2018 Dolphin Emulator Project
+// Licensed under GPLv2+
+// Refer to the license.txt file included.
+
+#include "AdaptiveShaderCompilation.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
+#include "Common/Logging/Log.h"
+
+#include "VideoCommon/VideoConfig.h"
+
+namespace AdaptiveShaderCompilation
+{
+// Frames on ubershaders before probing specialized shaders. Doubled after every fallback, so a
+// game that keeps streaming in new shaders settles on ubershaders.
+static constexpr u32 MIN_PROBE_INTERVAL_FRAMES = 600;
+static constexpr u32 MAX_PROBE_INTERVAL_FRAMES = 600 * 16;
+// Window over which new pipelines on specialized shaders are counted.
+static constexpr u32 SPIKE_WINDOW_FRAMES = 30;
+static constexpr u32 SPIKE_WINDOW_PIPELINES = 8;
+// A single frame blocked for longer than this on compiles is a spike on its own.
+static constexpr u64 SPIKE_FRAME_BLOCKED_US = 50000;
+// Frames without new pipelines before the working set counts as compiled.
+static constexpr u32 SETTLED_FRAMES = 300;
+
+static std::thread::id s_render_thread;
+static u64 s_render_thread_us = 0;
+static std::atomic<u32> s_created_pipelines{0};
+
+static u32 s_total_new_pipelines = 0;
+
+static u32 s_window_frames = 0;
+static u32 s_window_new_pipelines = 0;
+static u64 s_window_blocked_us = 0;
+
+static u32 s_frames_in_mode = 0;
+static u32 s_frames_since_new_pipeline = 0;
+static u32 s_probe_interval = MIN_PROBE_INTERVAL_FRAMES;
+static bool s_active = false;
+
+static void ResetWindow()
+{
+  s_window_frames = 0;
+  s_window_new_pipelines = 0;
+  s_window_blocked_us = 0;
+}
+
+static void SwitchMode(ShaderCompilationMode mode, const char* reason, u64 frame_blocked_us)
+{
+  NOTICE_LOG(VIDEO, "Adaptive shaders: switching to %s (%s). Last %u frames: %u new pipelines, "
+                    "%.2f ms/frame blocked, %.2f ms in the last frame, next probe in %u frames",
+             mode == ShaderCompilationMode::Synchronous ? "specialized shaders" : "ubershaders",
+             reason, s_window_frames, s_window_new_pipelines,
+             s_window_frames ? s_window_blocked_us / 1000.0 / s_window_frames : 0.0,
+             frame_blocked_us / 1000.0, s_probe_interval);
+
+  g_Config.iShaderCompilationMode = mode;
+  g_Config.MarkChanged();
+  s_frames_in_mode = 0;
+  ResetWindow();
+}
+
+void SetRenderThread()
+{
+  s_render_thread = std::this_thread::get_id();
+  s_render_thread_us = 0;
+}
+
+void RecordCompile(u64 elapsed_us)
+{
+  if (std::this_thread::get_id() == s_render_thread)
+    s_render_thread_us += elapsed_us;
+}
+
+void RecordPipelineCreated()
+{
+  s_created_pipelines++;
+}
+
+void Update()
+{
+  if (!g_Config.bAdaptiveShaderCompilation)
+  {
+    if (s_active)
+      Reset();
+    return;
+  }
+
+  // The shader cache only creates a pipeline for a UID it hasn't seen, so every creation is a
+  // new one. Compiles on the GPU thread are the ones the frame waited for.
+  const u32 new_pipelines = s_created_pipelines.exchange(0);
+  const u64 blocked_us = s_render_thread_us;
+  s_render_thread_us = 0;
+
+  if (!s_active)
+  {
+    s_active = true;
+    if (g_Config.iShaderCompilationMode != ShaderCompilationMode::SynchronousUberShaders)
+      SwitchMode(ShaderCompilationMode::SynchronousUberShaders, "enabled", 0);
+    return;
+  }
+
+  s_window_frames++;
+  s_window_new_pipelines += new_pipelines;
+  s_window_blocked_us += blocked_us;
+  s_total_new_pipelines += new_pipelines;
+  s_frames_in_mode++;
+  s_frames_since_new_pipeline = new_pipelines ? 0 : s_frames_since_new_pipeline + 1;
+
+  // The mode is written to g_Config, so it is read back from there too. The active config only
+  // picks it up at the next resync.
+  if (g_Config.iShaderCompilationMode == ShaderCompilationMode::Synchronous)
+  {
+    if (blocked_us >= SPIKE_FRAME_BLOCKED_US || s_window_new_pipelines >= SPIKE_WINDOW_PIPELINES)
+    {
+      s_probe_interval = std::min(s_probe_interval * 2, MAX_PROBE_INTERVAL_FRAMES);
+      SwitchMode(ShaderCompilationMode::SynchronousUberShaders, "compile spike", blocked_us);
+      return;
+    }
+
+    if (s_frames_since_new_pipeline == SETTLED_FRAMES)
+    {
+      s_probe_interval = MIN_PROBE_INTERVAL_FRAMES;
+      INFO_LOG(VIDEO, "Adaptive shaders: working set compiled after %u frames on specialized "
+                      "shaders, %u pipelines created",
+               s_frames_in_mode, s_total_new_pipelines);
+    }
+  }
+  else if (s_frames_in_mode >= s_probe_interval)
+  {
+    SwitchMode(ShaderCompilationMode::Synchronous, "probing", blocked_us);
+    return;
+  }
+
+  if (s_window_frames >= SPIKE_WINDOW_FRAMES)
+    ResetWindow();
+}
+
+void Reset()
+{
+  s_total_new_pipelines = 0;
+  s_frames_in_mode = 0;
+  s_frames_since_new_pipeline = 0;
+  s_probe_interval = MIN_PROBE_INTERVAL_FRAMES;
+  s_active = false;
+  ResetWindow();
+}
+}
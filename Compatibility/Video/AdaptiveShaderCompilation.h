@@ -0,0 +1,27 @@
+// Copyright 2018 Dolphin Emulator Project
+// Licensed under GPLv2+
+// Refer to the license.txt file included.
+
+// Picks the shader compilation mode at runtime. The core starts on ubershaders and probes
+// specialized shaders once the game has been running for a while, staying there when the
+// working set is compiled and falling back when a new scene brings in a burst of compiles.
+// The renderer reports the pipelines it creates and the time spent compiling; only compiles on
+// the GPU thread stall a frame.
+
+#pragma once
+
+#include "Common/CommonTypes.h"
+
+namespace AdaptiveShaderCompilation
+{
+// Called on the GPU thread, compiles on any other thread run in the background.
+void SetRenderThread();
+
+// Safe to call from any thread.
+void RecordCompile(u64 elapsed_us);
+void RecordPipelineCreated();
+
+// Called once per frame by the renderer, before the active config is updated.
+void Update();
+void Reset();
+}
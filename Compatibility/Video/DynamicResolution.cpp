@@ -0,0 +1,205 @@
+// Copyright 2018 Dolphin Emulator Project
+// Licensed under GPLv2+
+// Refer to the license.txt file included.
+
+#include "DynamicResolution.h"
+
+#include <algorithm>
+
+#include "Common/CommonTypes.h"
+#include "Common/Logging/Log.h"
+#include "Common/MathUtil.h"
+
+#include "Core/HW/VideoInterface.h"
+
+#include "VideoCommon/VideoConfig.h"
+
+#include "GPUTimer.h"
+
+namespace DynamicResolution
+{
+static constexpr int MAX_SCALE = 8;
+// Resolved frames averaged before each decision.
+static constexpr u32 WINDOW_FRAMES = 30;
+// Frames ignored after a change: queries still in flight were issued at the old scale, and the
+// first frames at the new one pay for reallocating the framebuffers.
+static constexpr u32 SETTLE_FRAMES = 60;
+// Consecutive windows over or under before acting, so a single busy scene doesn't flip the scale.
+static constexpr u32 WINDOWS_TO_DECREASE = 2;
+static constexpr u32 WINDOWS_TO_INCREASE = 4;
+// Fractions of the frame budget. A higher scale has to fit below the lower mark, which leaves a
+// gap to the upper one that the scale won't oscillate across.
+static constexpr double DECREASE_ABOVE = 0.90;
+static constexpr double INCREASE_BELOW = 0.70;
+// A scale that had to be dropped soon after increasing to it is retried only after this many
+// windows, doubling with each failed retry, so a scene between two scales settles on the lower.
+static constexpr u32 RETRY_WINDOWS = 8;
+static constexpr u32 MAX_RETRY_WINDOWS = 256;
+
+static u64 s_window_busy_ns = 0;
+static u32 s_window_frames = 0;
+static u32 s_settle_frames = 0;
+static u32 s_windows_over = 0;
+static u32 s_windows_under = 0;
+static u32 s_changes = 0;
+static bool s_active = false;
+static int s_increased_to = 0;  // until a decision is made at that scale
+static int s_blocked_scale = 0;
+static u32 s_blocked_windows = 0;
+static u32 s_retry_windows = RETRY_WINDOWS;
+
+static void ResetWindow()
+{
+  s_window_busy_ns = 0;
+  s_window_frames = 0;
+}
+
+static void SetScale(int scale)
+{
+  g_Config.iEFBScale = scale;
+  g_Config.MarkChanged();
+  s_settle_frames = SETTLE_FRAMES;
+  s_windows_over = 0;
+  s_windows_under = 0;
+  ResetWindow();
+}
+
+void Update()
+{
+  if (!g_Config.bDynamicResolution)
+  {
+    if (s_active)
+      Reset();
+    return;
+  }
+
+  u64 busy_ns;
+  u32 frames;
+  const int min_scale = std::max(g_Config.iDynamicResolutionMin, 1);
+  const int max_scale = std::min(std::max(g_Config.iDynamicResolutionMax, min_scale), MAX_SCALE);
+  if (!s_active)
+  {
+    s_active = true;
+    // Auto (0) follows the window size, start from the largest scale allowed instead.
+    const int scale = MathUtil::Clamp(g_Config.iEFBScale > 0 ? g_Config.iEFBScale : max_scale,
+                                      min_scale, max_scale);
+    if (scale != g_Config.iEFBScale)
+    {
+      INFO_LOG(VIDEO, "Dynamic resolution: starting at %dx native", scale);
+      SetScale(scale);
+    }
+    GPUTimer::TakeBusyTime(&busy_ns, &frames);
+    return;
+  }
+
+  if (!GPUTimer::TakeBusyTime(&busy_ns, &frames))
+    return;
+
+  if (s_settle_frames > 0)
+  {
+    s_settle_frames -= std::min(s_settle_frames, frames);
+    return;
+  }
+
+  s_window_busy_ns += busy_ns;
+  s_window_frames += frames;
+  if (s_window_frames < WINDOW_FRAMES)
+    return;
+
+  const u32 refresh_rate = std::max(VideoInterface::GetTargetRefreshRate(), 1u);
+  const double budget_ms = 1000.0 / refresh_rate;
+  const double busy_ms = s_window_busy_ns / 1e6 / s_window_frames;
+  const int scale = g_ActiveConfig.iEFBScale;
+  ResetWindow();
+  if (scale < 1)
+    return;
+  if (scale != MathUtil::Clamp(scale, min_scale, max_scale))
+  {
+    SetScale(MathUtil::Clamp(scale, min_scale, max_scale));
+    return;
+  }
+
+  if (s_blocked_windows > 0)
+    s_blocked_windows--;
+
+  // Most of the GPU time scales with the pixel count, so the time at another scale is predicted
+  // from the ratio of the areas. The rest doesn't, which only makes the prediction cautious.
+  const double up_ms = busy_ms * (scale + 1) * (scale + 1) / (scale * scale);
+  const char* decision = "hold";
+  if (scale > min_scale && busy_ms > budget_ms * DECREASE_ABOVE)
+  {
+    s_windows_under = 0;
+    decision = "over";
+    if (++s_windows_over >= WINDOWS_TO_DECREASE)
+    {
+      INFO_LOG(VIDEO, "Dynamic resolution: %dx -> %dx native, GPU %.2f ms of a %.2f ms budget",
+               scale, scale - 1, busy_ms, budget_ms);
+      if (scale == s_increased_to)
+      {
+        if (s_blocked_scale != scale)
+          s_retry_windows = RETRY_WINDOWS;
+        s_blocked_scale = scale;
+        s_blocked_windows = s_retry_windows;
+        s_retry_windows = std::min(s_retry_windows * 2, MAX_RETRY_WINDOWS);
+      }
+      s_increased_to = 0;
+      decision = "decrease";
+      SetScale(scale - 1);
+      s_changes++;
+    }
+  }
+  else if (scale < max_scale && up_ms < budget_ms * INCREASE_BELOW)
+  {
+    s_windows_over = 0;
+    if (scale + 1 == s_blocked_scale && s_blocked_windows > 0)
+    {
+      s_windows_under = 0;
+      decision = "retry later";
+    }
+    else if (++s_windows_under >= WINDOWS_TO_INCREASE)
+    {
+      INFO_LOG(VIDEO, "Dynamic resolution: %dx -> %dx native, GPU %.2f ms of a %.2f ms budget",
+               scale, scale + 1, busy_ms, budget_ms);
+      s_increased_to = scale + 1;
+      decision = "increase";
+      SetScale(scale + 1);
+      s_changes++;
+    }
+    else
+    {
+      decision = "under";
+    }
+  }
+  else
+  {
+    s_windows_over = 0;
+    s_windows_under = 0;
+    s_increased_to = 0;
+  }
+
+  // With the GPU timers on, every window is traced to show how the scale was decided.
+  if (g_ActiveConfig.bGPUTimers)
+  {
+    INFO_LOG(VIDEO, "Dynamic resolution: %dx, GPU %.2f ms of a %.2f ms budget, %.2f ms "
+                    "predicted at %dx -> %s",
+             scale, busy_ms, budget_ms, up_ms, scale + 1, decision);
+  }
+}
+
+void Reset()
+{
+  if (s_changes)
+    NOTICE_LOG(VIDEO, "Dynamic resolution: %u scale changes this session", s_changes);
+
+  ResetWindow();
+  s_settle_frames = 0;
+  s_windows_over = 0;
+  s_windows_under = 0;
+  s_changes = 0;
+  s_active = false;
+  s_increased_to = 0;
+  s_blocked_scale = 0;
+  s_blocked_windows = 0;
+  s_retry_windows = RETRY_WINDOWS;
+}
+}
@@ -0,0 +1,21 @@
+// Copyright 2018 Dolphin Emulator Project
+// Licensed under GPLv2+
+// Refer to the license.txt file included.
+
+// Adjusts the internal resolution (iEFBScale) to the GPU. The work GPUTimer measured in all
+// passes, which leaves out the time the GPU waited on the CPU or the present queue, is compared
+// against the frame budget of the game's refresh rate; the scale drops when the GPU runs over
+// and rises again once the higher scale is predicted to fit with room to spare, so a light scene
+// holds its scale. With bGPUTimers on, each decision window is logged. Changes go through
+// g_Config, so the framebuffers are recreated at the next swap with the EFB peek cache, the
+// prefetched readback and the bounding box values discarded.
+
+#pragma once
+
+namespace DynamicResolution
+{
+// Called once per frame by the renderer, after the XFB has been presented and before the
+// active config is updated.
+void Update();
+void Reset();
+}
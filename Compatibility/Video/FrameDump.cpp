@@ -0,0 +1,265 @@
+// Copyright 2018 Dolphin Emulator Project
+// Licensed under GPLv2+
+// Refer to the license.txt file included.
+
+#include "FrameDump.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "AudioCommon/WaveFile.h"
+#include "Common/CommonPaths.h"
+#include "Common/FileUtil.h"
+#include "Common/Logging/Log.h"
+#include "Common/Thread.h"
+#include "Common/Timer.h"
+#include "Core/ConfigManager.h"
+
+#if defined(HAVE_FFMPEG)
+#include "VideoCommon/AVIDump.h"
+#endif
+#include "VideoCommon/VideoConfig.h"
+
+namespace FrameDump
+{
+// Audio is held for at most this long when the worker falls behind, then dropped.
+static constexpr u32 MAX_PENDING_AUDIO_SECONDS = 2;
+
+struct QueuedFrame
+{
+  std::vector<u8> pixels;
+  int width;
+  int height;
+  int stride;
+#if defined(HAVE_FFMPEG)
+  AVIDump::Frame state;
+#endif
+};
+
+static std::mutex s_mutex;
+static std::condition_variable s_work_available;
+static std::condition_variable s_space_available;
+static std::deque<QueuedFrame> s_frames;
+static std::vector<std::vector<u8>> s_free_buffers;
+static std::thread s_worker;
+static bool s_running = false;
+static bool s_stop_requested = false;
+
+static std::mutex s_audio_mutex;
+static std::vector<short> s_pending_audio;
+static u32 s_audio_sample_rate = 0;
+static bool s_audio_enabled = false;
+
+// Statistics, reported at Stop().
+static u32 s_frames_submitted = 0;
+static u32 s_frames_encoded = 0;
+static u32 s_frames_dropped = 0;
+static u32 s_backpressure_waits = 0;
+static u64 s_backpressure_us = 0;
+static u64 s_encode_us = 0;
+static u32 s_max_queue_depth = 0;
+static u64 s_audio_frames_written = 0;
+static u64 s_audio_frames_dropped = 0;
+
+static size_t QueueCapacity()
+{
+  return static_cast<size_t>(std::max(g_ActiveConfig.iFrameDumpQueueDepth, 1));
+}
+
+static void WriteAudio(WaveFileWriter& writer, bool& writer_open)
+{
+  std::vector<short> samples;
+  u32 sample_rate;
+  {
+    std::lock_guard<std::mutex> lk(s_audio_mutex);
+    samples.swap(s_pending_audio);
+    sample_rate = s_audio_sample_rate;
+  }
+  if (samples.empty())
+    return;
+
+  if (!writer_open)
+  {
+    const std::string path = File::GetUserPath(D_DUMPAUDIO_IDX) + "framedump.wav";
+    File::CreateFullPath(path);
+    writer_open = writer.Start(path, sample_rate);
+    if (!writer_open)
+    {
+      WARN_LOG(VIDEO, "Frame dump: could not open %s, audio is not recorded", path.c_str());
+      return;
+    }
+  }
+
+  writer.AddStereoSamples(samples.data(), static_cast<u32>(samples.size() / 2));
+  s_audio_frames_written += samples.size() / 2;
+}
+
+static void WorkerThread()
+{
+  Common::SetCurrentThreadName("Frame dump");
+
+  WaveFileWriter audio_writer;
+  bool audio_writer_open = false;
+#if defined(HAVE_FFMPEG)
+  bool video_started = false;
+#endif
+
+  std::unique_lock<std::mutex> lk(s_mutex);
+  while (true)
+  {
+    s_work_available.wait(lk, [] { return s_stop_requested || !s_frames.empty(); });
+    if (s_frames.empty())
+      break;
+
+    QueuedFrame frame = std::move(s_frames.front());
+    s_frames.pop_front();
+    s_space_available.notify_one();
+    lk.unlock();
+
+    const u64 start_us = Common::Timer::GetTimeUs();
+#if defined(HAVE_FFMPEG)
+    if (!video_started)
+      video_started = AVIDump::Start(frame.width, frame.height);
+    // Rows arrive bottom-up, swscale flips them while converting when walked backwards.
+    if (video_started)
+    {
+      AVIDump::AddFrame(frame.pixels.data() + (frame.height - 1) * frame.stride, frame.width,
+                        frame.height, -frame.stride, frame.state);
+    }
+#endif
+    WriteAudio(audio_writer, audio_writer_open);
+    const u64 encode_us = Common::Timer::GetTimeUs() - start_us;
+
+    lk.lock();
+    s_frames_encoded++;
+    s_encode_us += encode_us;
+    if (s_free_buffers.size() < QueueCapacity() + 2)
+      s_free_buffers.push_back(std::move(frame.pixels));
+  }
+  lk.unlock();
+
+  WriteAudio(audio_writer, audio_writer_open);
+  if (audio_writer_open)
+    audio_writer.Stop();
+#if defined(HAVE_FFMPEG)
+  if (video_started)
+    AVIDump::Stop();
+#endif
+}
+
+bool IsEnabled()
+{
+  return SConfig::GetInstance().m_DumpFrames;
+}
+
+std::vector<u8> AcquireBuffer(size_t size)
+{
+  std::vector<u8> buffer;
+  {
+    std::lock_guard<std::mutex> lk(s_mutex);
+    if (!s_free_buffers.empty())
+    {
+      buffer = std::move(s_free_buffers.back());
+      s_free_buffers.pop_back();
+    }
+  }
+  buffer.resize(size);
+  return buffer;
+}
+
+void SubmitFrame(std::vector<u8> pixels, int width, int height, int stride, u64 ticks)
+{
+  QueuedFrame frame{std::move(pixels), width, height, stride};
+#if defined(HAVE_FFMPEG)
+  frame.state = AVIDump::FetchState(ticks);
+#endif
+
+  std::unique_lock<std::mutex> lk(s_mutex);
+  if (!s_running)
+  {
+    s_running = true;
+    s_stop_requested = false;
+    s_worker = std::thread(WorkerThread);
+    std::lock_guard<std::mutex> audio_lk(s_audio_mutex);
+    s_audio_enabled = true;
+  }
+
+  s_frames_submitted++;
+  if (s_frames.size() >= QueueCapacity())
+  {
+    if (!g_ActiveConfig.bFrameDumpBackpressure)
+    {
+      // Keep the emulation at speed, the recording skips a frame instead.
+      s_frames_dropped++;
+      if (s_free_buffers.size() < QueueCapacity() + 2)
+        s_free_buffers.push_back(std::move(frame.pixels));
+      return;
+    }
+
+    const u64 start_us = Common::Timer::GetTimeUs();
+    s_space_available.wait(lk, [] { return s_frames.size() < QueueCapacity(); });
+    s_backpressure_waits++;
+    s_backpressure_us += Common::Timer::GetTimeUs() - start_us;
+  }
+
+  s_frames.push_back(std::move(frame));
+  s_max_queue_depth = std::max(s_max_queue_depth, static_cast<u32>(s_frames.size()));
+  s_work_available.notify_one();
+}
+
+void SubmitAudio(const short* samples, u32 num_frames, u32 sample_rate)
+{
+  std::lock_guard<std::mutex> lk(s_audio_mutex);
+  if (!s_audio_enabled)
+    return;
+
+  if (s_pending_audio.size() / 2 + num_frames > MAX_PENDING_AUDIO_SECONDS * sample_rate)
+  {
+    s_audio_frames_dropped += num_frames;
+    return;
+  }
+
+  s_audio_sample_rate = sample_rate;
+  s_pending_audio.insert(s_pending_audio.end(), samples, samples + num_frames * 2);
+}
+
+void Stop()
+{
+  {
+    std::lock_guard<std::mutex> lk(s_mutex);
+    if (!s_running)
+      return;
+    s_stop_requested = true;
+    s_work_available.notify_one();
+  }
+  s_worker.join();
+
+  NOTICE_LOG(VIDEO, "Frame dump: %u frames submitted, %u encoded (%.2f ms each), %u dropped, "
+                    "%u backpressure waits (%.2f ms), queue peaked at %u of %zu. "
+                    "Audio: %llu frames written, %llu dropped",
+             s_frames_submitted, s_frames_encoded,
+             s_frames_encoded ? s_encode_us / 1000.0 / s_frames_encoded : 0.0, s_frames_dropped,
+             s_backpressure_waits, s_backpressure_us / 1000.0, s_max_queue_depth,
+             QueueCapacity(), static_cast<unsigned long long>(s_audio_frames_written),
+             static_cast<unsigned long long>(s_audio_frames_dropped));
+
+  {
+    std::lock_guard<std::mutex> audio_lk(s_audio_mutex);
+    s_audio_enabled = false;
+    s_pending_audio.clear();
+  }
+
+  std::lock_guard<std::mutex> lk(s_mutex);
+  s_running = false;
+  s_stop_requested = false;
+  s_free_buffers.clear();
+  s_frames_submitted = s_frames_encoded = s_frames_dropped = s_backpressure_waits = 0;
+  s_backpressure_us = s_encode_us = 0;
+  s_max_queue_depth = 0;
+  s_audio_frames_written = s_audio_frames_dropped = 0;
+}
+}
@@ -0,0 +1,32 @@
+// Copyright 2018 Dolphin Emulator Project
+// Licensed under GPLv2+
+// Refer to the license.txt file included.
+
+// Asynchronous frame dumping. The renderer reads the XFB back through a ring of PBOs and hands
+// the mapped frames over here; colour conversion and encoding happen on a worker thread along
+// with the mixer output, so dumping doesn't stall the render thread.
+
+#pragma once
+
+#include <vector>
+
+#include "Common/CommonTypes.h"
+
+namespace FrameDump
+{
+// Whether frames should currently be read back for dumping.
+bool IsEnabled();
+
+// Returns a pooled buffer of at least size bytes, to be filled and passed to SubmitFrame.
+std::vector<u8> AcquireBuffer(size_t size);
+
+// Queues a bottom-up RGBA8 frame. When the queue is full the frame is dropped, or the caller
+// waits for the encoder if bFrameDumpBackpressure is set.
+void SubmitFrame(std::vector<u8> pixels, int width, int height, int stride, u64 ticks);
+
+// Called from the audio thread with interleaved stereo samples, ignored while not dumping.
+void SubmitAudio(const short* samples, u32 num_frames, u32 sample_rate);
+
+// Flushes the queue, finishes the files and logs the session statistics.
+void Stop();
+}
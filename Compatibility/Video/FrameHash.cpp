@@ -0,0 +1,43 @@
+// Copyright 2018 Dolphin Emulator Project
+// Licensed under GPLv2+
+// Refer to the license.txt file included.
+
+#include "FrameHash.h"
+
+#include <cinttypes>
+#include <mutex>
+
+#include "Common/Hash.h"
+#include "Common/Logging/Log.h"
+
+#include "VideoCommon/VideoConfig.h"
+
+namespace FrameHash
+{
+static std::mutex s_callback_mutex;
+static Callback s_callback;
+
+void SetCallback(Callback callback)
+{
+  std::lock_guard<std::mutex> lk(s_callback_mutex);
+  s_callback = std::move(callback);
+}
+
+bool IsDue(u64 frame_number)
+{
+  const int interval = g_ActiveConfig.iFrameHashInterval;
+  return interval > 0 && frame_number % interval == 0;
+}
+
+void Submit(u64 frame_number, const u8* data, u32 size)
+{
+  // Sample every pixel, the point is to catch any difference.
+  const u64 hash = GetHash64(data, size, 0);
+
+  std::lock_guard<std::mutex> lk(s_callback_mutex);
+  if (s_callback)
+    s_callback(frame_number, hash);
+  else
+    NOTICE_LOG(VIDEO, "Frame %" PRIu64 " hash %016" PRIx64, frame_number, hash);
+}
+}
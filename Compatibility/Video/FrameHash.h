@@ -0,0 +1,24 @@
+// Copyright 2018 Dolphin Emulator Project
+// Licensed under GPLv2+
+// Refer to the license.txt file included.
+
+// Periodic hashing of the output frame, so that rendering can be verified when nothing is
+// being presented. Enabled with iFrameHashInterval.
+
+#pragma once
+
+#include <functional>
+
+#include "Common/CommonTypes.h"
+
+namespace FrameHash
+{
+using Callback = std::function<void(u64 frame_number, u64 hash)>;
+
+// Hashes are logged when no callback is set.
+void SetCallback(Callback callback);
+
+// Whether the renderer should read back and hash this frame.
+bool IsDue(u64 frame_number);
+void Submit(u64 frame_number, const u8* data, u32 size);
+}
@@ -0,0 +1,267 @@
+// Copyright 2018 Dolphin Emulator Project
+// Licensed under GPLv2+
+// Refer to the license.txt file included.
+
+#include "GLStateTracker.h"
+
+#include <array>
+
+#include "Common/Logging/Log.h"
+
+namespace GLStateTracker
+{
+static constexpr u64 STATS_INTERVAL = 600;
+
+enum Cap : u32
+{
+  CAP_BLEND,
+  CAP_DEPTH_TEST,
+  CAP_CULL_FACE,
+  CAP_SCISSOR_TEST,
+  CAP_COLOR_LOGIC_OP,
+  CAP_CLIP_DISTANCE0,
+  CAP_CLIP_DISTANCE1,
+  CAP_COUNT
+};
+
+// -1 is unknown for the tri-state values, known flags cover the rest.
+struct State
+{
+  std::array<s8, CAP_COUNT> caps;
+  s8 color_mask_rgb;
+  s8 color_mask_alpha;
+  s8 depth_mask;
+  GLenum depth_func;
+  GLenum front_face;
+  GLenum blend_equation[2];
+  GLenum blend_func[4];
+  GLenum logic_op;
+  bool viewport_known;
+  float viewport[4];
+  bool depth_range_known;
+  float depth_range[2];
+  bool scissor_known;
+  GLint scissor[4];
+  bool framebuffer_known;
+  GLuint framebuffer;
+};
+
+// GL_NONE never is a valid value for any of the enums tracked.
+static const State UNKNOWN_STATE = {
+    {-1, -1, -1, -1, -1, -1, -1}, -1, -1, -1, GL_NONE, GL_NONE, {GL_NONE, GL_NONE},
+    {GL_NONE, GL_NONE, GL_NONE, GL_NONE}, GL_NONE, false, {}, false, {}, false, {}, false, 0,
+};
+
+static State s_state = UNKNOWN_STATE;
+static u64 s_issued = 0;
+static u64 s_skipped = 0;
+
+static bool Skip(bool unchanged)
+{
+  if (unchanged)
+    s_skipped++;
+  else
+    s_issued++;
+  return unchanged;
+}
+
+static int CapIndex(GLenum cap)
+{
+  switch (cap)
+  {
+  case GL_BLEND:
+    return CAP_BLEND;
+  case GL_DEPTH_TEST:
+    return CAP_DEPTH_TEST;
+  case GL_CULL_FACE:
+    return CAP_CULL_FACE;
+  case GL_SCISSOR_TEST:
+    return CAP_SCISSOR_TEST;
+  case GL_COLOR_LOGIC_OP:
+    return CAP_COLOR_LOGIC_OP;
+  case GL_CLIP_DISTANCE0:
+    return CAP_CLIP_DISTANCE0;
+  case GL_CLIP_DISTANCE1:
+    return CAP_CLIP_DISTANCE1;
+  default:
+    return -1;
+  }
+}
+
+void Invalidate()
+{
+  s_state = UNKNOWN_STATE;
+}
+
+void InvalidateFramebuffer()
+{
+  s_state.framebuffer_known = false;
+}
+
+void SetEnabled(GLenum cap, bool enabled)
+{
+  const int index = CapIndex(cap);
+  if (index >= 0)
+  {
+    if (Skip(s_state.caps[index] == static_cast<s8>(enabled)))
+      return;
+    s_state.caps[index] = enabled;
+  }
+
+  if (enabled)
+    glEnable(cap);
+  else
+    glDisable(cap);
+}
+
+void SetColorMask(bool rgb, bool alpha)
+{
+  if (Skip(s_state.color_mask_rgb == static_cast<s8>(rgb) &&
+           s_state.color_mask_alpha == static_cast<s8>(alpha)))
+    return;
+  s_state.color_mask_rgb = rgb;
+  s_state.color_mask_alpha = alpha;
+  glColorMask(rgb, rgb, rgb, alpha);
+}
+
+void SetDepthMask(bool enabled)
+{
+  if (Skip(s_state.depth_mask == static_cast<s8>(enabled)))
+    return;
+  s_state.depth_mask = enabled;
+  glDepthMask(enabled ? GL_TRUE : GL_FALSE);
+}
+
+void SetDepthFunc(GLenum func)
+{
+  if (Skip(s_state.depth_func == func))
+    return;
+  s_state.depth_func = func;
+  glDepthFunc(func);
+}
+
+void SetFrontFace(GLenum mode)
+{
+  if (Skip(s_state.front_face == mode))
+    return;
+  s_state.front_face = mode;
+  glFrontFace(mode);
+}
+
+void SetBlendEquation(GLenum rgb, GLenum alpha)
+{
+  if (Skip(s_state.blend_equation[0] == rgb && s_state.blend_equation[1] == alpha))
+    return;
+  s_state.blend_equation[0] = rgb;
+  s_state.blend_equation[1] = alpha;
+  glBlendEquationSeparate(rgb, alpha);
+}
+
+void SetBlendFunc(GLenum src_rgb, GLenum dst_rgb, GLenum src_alpha, GLenum dst_alpha)
+{
+  GLenum* func = s_state.blend_func;
+  if (Skip(func[0] == src_rgb && func[1] == dst_rgb && func[2] == src_alpha &&
+           func[3] == dst_alpha))
+    return;
+  func[0] = src_rgb;
+  func[1] = dst_rgb;
+  func[2] = src_alpha;
+  func[3] = dst_alpha;
+  glBlendFuncSeparate(src_rgb, dst_rgb, src_alpha, dst_alpha);
+}
+
+void SetLogicOp(GLenum op)
+{
+  if (Skip(s_state.logic_op == op))
+    return;
+  s_state.logic_op = op;
+  glLogicOp(op);
+}
+
+static bool UpdateViewport(float x, float y, float width, float height)
+{
+  float* viewport = s_state.viewport;
+  if (Skip(s_state.viewport_known && viewport[0] == x && viewport[1] == y &&
+           viewport[2] == width && viewport[3] == height))
+    return false;
+  s_state.viewport_known = true;
+  viewport[0] = x;
+  viewport[1] = y;
+  viewport[2] = width;
+  viewport[3] = height;
+  return true;
+}
+
+void SetViewport(float x, float y, float width, float height)
+{
+  if (UpdateViewport(x, y, width, height))
+    glViewportIndexedf(0, x, y, width, height);
+}
+
+void SetViewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+  if (UpdateViewport(static_cast<float>(x), static_cast<float>(y), static_cast<float>(width),
+                     static_cast<float>(height)))
+    glViewport(x, y, width, height);
+}
+
+void SetDepthRange(float near_depth, float far_depth)
+{
+  if (Skip(s_state.depth_range_known && s_state.depth_range[0] == near_depth &&
+           s_state.depth_range[1] == far_depth))
+    return;
+  s_state.depth_range_known = true;
+  s_state.depth_range[0] = near_depth;
+  s_state.depth_range[1] = far_depth;
+  glDepthRangef(near_depth, far_depth);
+}
+
+void SetScissor(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+  GLint* scissor = s_state.scissor;
+  if (Skip(s_state.scissor_known && scissor[0] == x && scissor[1] == y && scissor[2] == width &&
+           scissor[3] == height))
+    return;
+  s_state.scissor_known = true;
+  scissor[0] = x;
+  scissor[1] = y;
+  scissor[2] = width;
+  scissor[3] = height;
+  glScissor(x, y, width, height);
+}
+
+void BindFramebuffer(GLuint fbo)
+{
+  if (Skip(s_state.framebuffer_known && s_state.framebuffer == fbo))
+    return;
+  s_state.framebuffer_known = true;
+  s_state.framebuffer = fbo;
+  glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+}
+
+void CountSkipped()
+{
+  s_skipped++;
+}
+
+void CountIssued()
+{
+  s_issued++;
+}
+
+void EndFrame(u64 frame_number)
+{
+  if (frame_number % STATS_INTERVAL != 0)
+    return;
+
+  if (s_issued + s_skipped)
+  {
+    INFO_LOG(VIDEO, "GL state: %.1f calls issued, %.1f skipped per frame (%.1f%% redundant)",
+             static_cast<double>(s_issued) / STATS_INTERVAL,
+             static_cast<double>(s_skipped) / STATS_INTERVAL,
+             100.0 * s_skipped / (s_issued + s_skipped));
+  }
+  s_issued = 0;
+  s_skipped = 0;
+}
+}
@@ -0,0 +1,50 @@
+// Copyright 2018 Dolphin Emulator Project
+// Licensed under GPLv2+
+// Refer to the license.txt file included.
+
+// Shadow copy of the fixed-function GL state the renderer sets between draws: capabilities,
+// colour and depth masks, depth function, front face, blending, logic op, viewport, depth range,
+// scissor and the draw framebuffer. Calls that wouldn't change anything are skipped.
+//
+// Code outside the renderer changes GL state directly, so the whole shadow is invalidated
+// whenever control passes to it (Reset/RestoreAPIState). The program, vertex array and sampler
+// bindings already have their own trackers upstream and are not duplicated here.
+
+#pragma once
+
+#include "Common/CommonTypes.h"
+#include "Common/GL/GLUtil.h"
+
+namespace GLStateTracker
+{
+// Forgets everything, the next call of each setter is issued.
+void Invalidate();
+void InvalidateFramebuffer();
+
+// GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE, GL_SCISSOR_TEST, GL_COLOR_LOGIC_OP and
+// GL_CLIP_DISTANCE0/1. Other capabilities are passed through.
+void SetEnabled(GLenum cap, bool enabled);
+
+void SetColorMask(bool rgb, bool alpha);
+void SetDepthMask(bool enabled);
+void SetDepthFunc(GLenum func);
+void SetFrontFace(GLenum mode);
+void SetBlendEquation(GLenum rgb, GLenum alpha);
+void SetBlendFunc(GLenum src_rgb, GLenum dst_rgb, GLenum src_alpha, GLenum dst_alpha);
+void SetLogicOp(GLenum op);
+
+// The float version uses glViewportIndexedf, the integer one glViewport.
+void SetViewport(float x, float y, float width, float height);
+void SetViewport(GLint x, GLint y, GLsizei width, GLsizei height);
+void SetDepthRange(float near_depth, float far_depth);
+void SetScissor(GLint x, GLint y, GLsizei width, GLsizei height);
+
+void BindFramebuffer(GLuint fbo);
+
+// Counts a call elided by a tracker that lives elsewhere, such as the bound texture list.
+void CountSkipped();
+void CountIssued();
+
+// Logs the issued and skipped calls per frame every so often.
+void EndFrame(u64 frame_number);
+}
@@ -0,0 +1,417 @@
+// Copyright 2018 Dolphin Emulator Project
+// Licensed under GPLv2+
+// Refer to the license.txt file included.
+
+#include "GPUTimer.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <deque>
+#include <limits>
+#include <vector>
+
+#include "Common/CommonPaths.h"
+#include "Common/File.h"
+#include "Common/FileUtil.h"
+#include "Common/GL/GLExtensions/GLExtensions.h"
+#include "Common/GL/GLUtil.h"
+#include "Common/Logging/Log.h"
+#include "Common/StringUtil.h"
+#include "Common/Timer.h"
+
+#include "VideoCommon/VideoConfig.h"
+
+namespace GPUTimer
+{
+static constexpr u32 PASS_COUNT = static_cast<u32>(Pass::Count);
+static const char* const PASS_NAMES[PASS_COUNT] = {
+    "efb_draw", "efb_copy",     "resolve", "reinterpret", "clear",      "efb_poke",
+    "efb_peek", "efb_prefetch", "present", "osd",         "frame_dump",
+};
+
+// Frames waiting for their results. Past this the oldest is dropped rather than waited for.
+static constexpr size_t MAX_PENDING_FRAMES = 8;
+// Resolved frames kept for ExportTimeline.
+static constexpr size_t TIMELINE_FRAMES = 600;
+static constexpr u32 SUMMARY_INTERVAL = 300;
+// Resolved frames over which the GPU clock offset is re-estimated.
+static constexpr u32 CLOCK_WINDOW_FRAMES = 600;
+
+struct PendingInterval
+{
+  Pass pass;
+  GLuint begin;
+  GLuint end;
+  u64 submitted_ns;  // CPU time once the whole pass had been submitted
+};
+
+struct PendingFrame
+{
+  u64 number = 0;
+  u64 cpu_us = 0;
+  GLuint start = 0;
+  std::vector<PendingInterval> intervals;
+};
+
+struct Interval
+{
+  Pass pass;
+  u64 begin_ns;  // relative to the start of the frame
+  u64 end_ns;
+  u64 work_ns;
+};
+
+struct ResolvedFrame
+{
+  u64 number;
+  u64 cpu_us;
+  u64 gpu_span_ns;
+  std::vector<Interval> intervals;
+};
+
+static int s_supported = -1;
+static std::vector<GLuint> s_free_queries;
+static PendingFrame s_current;
+static std::array<GLuint, PASS_COUNT> s_open = {};
+// Passes that paused EFBDraw when they began, and resume it when they end.
+static std::array<bool, PASS_COUNT> s_paused_draw = {};
+static std::deque<PendingFrame> s_pending;
+static std::deque<ResolvedFrame> s_timeline;
+static u64 s_last_frame_us = 0;
+static bool s_used = false;
+
+// Rolling summary over SUMMARY_INTERVAL resolved frames.
+static std::array<u64, PASS_COUNT> s_summary_pass_ns = {};
+static u64 s_summary_span_ns = 0;
+static u64 s_summary_work_ns = 0;
+static u64 s_summary_cpu_us = 0;
+static u32 s_summary_frames = 0;
+static u32 s_dropped_frames = 0;
+
+// The GPU clock minus the CPU clock. A timestamp never executes before it was issued, and
+// executes right away whenever the GPU has caught up with the CPU, so the smallest difference
+// between a result and the time it was issued at is the offset.
+static s64 s_clock_offset_ns = 0;
+static bool s_clock_calibrated = false;
+static s64 s_window_offset_ns = std::numeric_limits<s64>::max();
+static u32 s_window_frames = 0;
+
+// Busy time since the last TakeBusyTime.
+static u64 s_taken_busy_ns = 0;
+static u32 s_taken_frames = 0;
+
+static bool IsEnabled()
+{
+  if (!g_ActiveConfig.bGPUTimers && !g_ActiveConfig.bDynamicResolution)
+    return false;
+  if (s_supported < 0)
+  {
+    s_supported = GLExtensions::Version() >= 330 || GLExtensions::Supports("GL_ARB_timer_query");
+    if (!s_supported)
+      WARN_LOG(VIDEO, "GPU timers: timestamp queries are not supported by this driver");
+  }
+  return s_supported != 0;
+}
+
+static u64 CPUTime()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+static GLuint Timestamp()
+{
+  GLuint query;
+  if (s_free_queries.empty())
+  {
+    glGenQueries(1, &query);
+  }
+  else
+  {
+    query = s_free_queries.back();
+    s_free_queries.pop_back();
+  }
+  glQueryCounter(query, GL_TIMESTAMP);
+  return query;
+}
+
+static void ReleaseQueries(PendingFrame& frame)
+{
+  s_free_queries.push_back(frame.start);
+  for (const PendingInterval& interval : frame.intervals)
+  {
+    s_free_queries.push_back(interval.begin);
+    s_free_queries.push_back(interval.end);
+  }
+  frame.intervals.clear();
+}
+
+static u64 QueryResult(GLuint query)
+{
+  GLuint64 result = 0;
+  glGetQueryObjectui64v(query, GL_QUERY_RESULT, &result);
+  return result;
+}
+
+static void ResetSummary()
+{
+  s_summary_pass_ns = {};
+  s_summary_span_ns = 0;
+  s_summary_work_ns = 0;
+  s_summary_cpu_us = 0;
+  s_summary_frames = 0;
+  s_dropped_frames = 0;
+}
+
+static void LogSummary()
+{
+  const double frames = s_summary_frames;
+  std::string passes;
+  for (u32 i = 0; i < PASS_COUNT; ++i)
+  {
+    if (!s_summary_pass_ns[i])
+      continue;
+    passes += StringFromFormat(" %s %.2f", PASS_NAMES[i], s_summary_pass_ns[i] / 1e6 / frames);
+  }
+  // The passes don't overlap, so their work adds up to what the GPU did in the frame. Idle time
+  // waiting on the CPU isn't part of it, which is what tells a GPU bound frame apart.
+  const double cpu_ms = s_summary_cpu_us / 1000.0 / frames;
+  const double work_ms = s_summary_work_ns / 1e6 / frames;
+  INFO_LOG(VIDEO, "GPU timers (ms/frame of work over %u frames):%s | GPU work %.2f, span %.2f, "
+                  "CPU frame %.2f -> %s, %u frames dropped",
+           s_summary_frames, passes.c_str(), work_ms, s_summary_span_ns / 1e6 / frames, cpu_ms,
+           work_ms > cpu_ms * 0.9 ? "GPU bound" : "CPU bound", s_dropped_frames);
+
+  ResetSummary();
+}
+
+static void Resolve(PendingFrame& pending)
+{
+  // Dynamic resolution alone only needs the busy time, the timeline is kept for bGPUTimers.
+  const bool keep = g_ActiveConfig.bGPUTimers;
+  ResolvedFrame frame{pending.number, pending.cpu_us, 0};
+  if (keep)
+    frame.intervals.reserve(pending.intervals.size());
+  const u64 start = QueryResult(pending.start);
+  u64 frame_work_ns = 0;
+  for (const PendingInterval& interval : pending.intervals)
+  {
+    const u64 begin = QueryResult(interval.begin);
+    const u64 end = std::max(QueryResult(interval.end), begin);
+    s_window_offset_ns = std::min(s_window_offset_ns, static_cast<s64>(end - interval.submitted_ns));
+    // Before the pass was fully submitted the GPU may have been waiting on the CPU. Until the
+    // clocks are calibrated the whole span counts.
+    const u64 submitted =
+        s_clock_calibrated ? static_cast<u64>(interval.submitted_ns + s_clock_offset_ns) : begin;
+    const u64 work_ns = end - std::max(begin, std::min(submitted, end));
+    const u64 end_ns = end - std::min(end, start);
+    if (keep)
+      frame.intervals.push_back({interval.pass, begin - std::min(begin, start), end_ns, work_ns});
+    frame.gpu_span_ns = std::max(frame.gpu_span_ns, end_ns);
+    s_summary_pass_ns[static_cast<u32>(interval.pass)] += work_ns;
+    frame_work_ns += work_ns;
+  }
+  s_taken_busy_ns += frame_work_ns;
+  s_taken_frames++;
+  if (!s_clock_calibrated || ++s_window_frames == CLOCK_WINDOW_FRAMES)
+  {
+    if (s_window_offset_ns != std::numeric_limits<s64>::max())
+    {
+      s_clock_offset_ns = s_window_offset_ns;
+      s_clock_calibrated = true;
+    }
+    s_window_offset_ns = std::numeric_limits<s64>::max();
+    s_window_frames = 0;
+  }
+  s_summary_work_ns += frame_work_ns;
+  s_summary_span_ns += frame.gpu_span_ns;
+  s_summary_cpu_us += frame.cpu_us;
+  if (++s_summary_frames == SUMMARY_INTERVAL)
+  {
+    if (g_ActiveConfig.bGPUTimers)
+      LogSummary();
+    else
+      ResetSummary();
+  }
+
+  if (!keep)
+    return;
+  s_timeline.push_back(std::move(frame));
+  if (s_timeline.size() > TIMELINE_FRAMES)
+    s_timeline.pop_front();
+}
+
+// Resolves the frames whose queries have all completed, without waiting on any.
+static void Collect()
+{
+  while (!s_pending.empty())
+  {
+    PendingFrame& frame = s_pending.front();
+    const GLuint last = frame.intervals.empty() ? frame.start : frame.intervals.back().end;
+    GLint available = 0;
+    glGetQueryObjectiv(last, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+    {
+      if (s_pending.size() <= MAX_PENDING_FRAMES)
+        break;
+      s_dropped_frames++;
+    }
+    else
+    {
+      Resolve(frame);
+    }
+    ReleaseQueries(frame);
+    s_pending.pop_front();
+  }
+}
+
+void Begin(Pass pass)
+{
+  const u32 index = static_cast<u32>(pass);
+  if (s_open[index] || !IsEnabled())
+    return;
+
+  const u32 draw = static_cast<u32>(Pass::EFBDraw);
+  if (pass != Pass::EFBDraw && s_open[draw])
+  {
+    End(Pass::EFBDraw);
+    s_paused_draw[index] = true;
+  }
+
+  if (!s_current.start)
+    s_current.start = Timestamp();
+  s_open[index] = Timestamp();
+  s_used |= g_ActiveConfig.bGPUTimers;
+}
+
+void End(Pass pass)
+{
+  const u32 index = static_cast<u32>(pass);
+  if (!s_open[index])
+    return;
+
+  const GLuint end = Timestamp();
+  s_current.intervals.push_back({pass, s_open[index], end, CPUTime()});
+  s_open[index] = 0;
+
+  if (s_paused_draw[index])
+  {
+    s_paused_draw[index] = false;
+    Begin(Pass::EFBDraw);
+  }
+}
+
+void Split(Pass pass)
+{
+  if (!s_open[static_cast<u32>(pass)])
+    return;
+
+  End(pass);
+  Begin(pass);
+}
+
+void EndFrame(u64 frame_number)
+{
+  const u64 now_us = Common::Timer::GetTimeUs();
+  const u64 cpu_us = s_last_frame_us ? now_us - s_last_frame_us : 0;
+  s_last_frame_us = now_us;
+
+  // Passes still open carry over into the next frame, along with the draw pass they paused.
+  const std::array<bool, PASS_COUNT> paused_draw = s_paused_draw;
+  s_paused_draw = {};
+  std::array<bool, PASS_COUNT> carried = {};
+  for (u32 i = 0; i < PASS_COUNT; ++i)
+  {
+    carried[i] = s_open[i] != 0;
+    End(static_cast<Pass>(i));
+  }
+
+  if (s_current.start)
+  {
+    s_current.number = frame_number;
+    s_current.cpu_us = cpu_us;
+    s_pending.push_back(std::move(s_current));
+    s_current = PendingFrame();
+  }
+  if (!s_pending.empty())
+    Collect();
+
+  for (u32 i = 0; i < PASS_COUNT; ++i)
+  {
+    if (carried[i])
+      Begin(static_cast<Pass>(i));
+  }
+  s_paused_draw = paused_draw;
+}
+
+bool TakeBusyTime(u64* busy_ns, u32* frames)
+{
+  if (!s_taken_frames)
+    return false;
+
+  *busy_ns = s_taken_busy_ns;
+  *frames = s_taken_frames;
+  s_taken_busy_ns = 0;
+  s_taken_frames = 0;
+  return true;
+}
+
+bool ExportTimeline(const std::string& path)
+{
+  File::IOFile file(path, "w");
+  if (!file)
+    return false;
+
+  std::string csv = "frame,cpu_frame_us,gpu_span_us,pass,begin_us,end_us,work_us\n";
+  for (const ResolvedFrame& frame : s_timeline)
+  {
+    for (const Interval& interval : frame.intervals)
+    {
+      csv += StringFromFormat("%llu,%llu,%.1f,%s,%.1f,%.1f,%.1f\n",
+                              static_cast<unsigned long long>(frame.number),
+                              static_cast<unsigned long long>(frame.cpu_us),
+                              frame.gpu_span_ns / 1000.0, PASS_NAMES[static_cast<u32>(interval.pass)],
+                              interval.begin_ns / 1000.0, interval.end_ns / 1000.0,
+                              interval.work_ns / 1000.0);
+    }
+  }
+  return file.WriteBytes(csv.data(), csv.size());
+}
+
+void Shutdown()
+{
+  if (s_used)
+  {
+    const std::string path = File::GetUserPath(D_DUMP_IDX) + "GPUTimeline.csv";
+    File::CreateFullPath(path);
+    if (ExportTimeline(path))
+      NOTICE_LOG(VIDEO, "GPU timers: timeline of %zu frames written to %s", s_timeline.size(),
+                 path.c_str());
+  }
+
+  s_open = {};
+  s_paused_draw = {};
+  ReleaseQueries(s_current);
+  s_current = PendingFrame();
+  for (PendingFrame& frame : s_pending)
+    ReleaseQueries(frame);
+  s_pending.clear();
+  s_free_queries.erase(std::remove(s_free_queries.begin(), s_free_queries.end(), 0u),
+                       s_free_queries.end());
+  if (!s_free_queries.empty())
+    glDeleteQueries(static_cast<GLsizei>(s_free_queries.size()), s_free_queries.data());
+  s_free_queries.clear();
+  s_timeline.clear();
+  s_last_frame_us = 0;
+  s_used = false;
+  ResetSummary();
+  s_taken_busy_ns = 0;
+  s_taken_frames = 0;
+  s_clock_offset_ns = 0;
+  s_clock_calibrated = false;
+  s_window_offset_ns = std::numeric_limits<s64>::max();
+  s_window_frames = 0;
+}
+}
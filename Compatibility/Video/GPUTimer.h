@@ -0,0 +1,75 @@
+// Copyright 2018 Dolphin Emulator Project
+// Licensed under GPLv2+
+// Refer to the license.txt file included.
+
+// GPU timing of the renderer's passes with GL_TIMESTAMP queries. Results are collected a few
+// frames later, once the queries are available, so timing never stalls the pipeline. Enabled
+// with bGPUTimers; a rolling summary is logged and the timeline can be exported as CSV.
+// Dynamic resolution turns the queries on too, but only reads the busy time back.
+//
+// The span between two timestamps includes any time the GPU sat idle waiting for the CPU to
+// submit more work. The CPU time is recorded when a pass ends and mapped onto the GPU clock, and
+// only the part of the pass the GPU spent after that point, or after the pass began if it began
+// later, counts as work: by then every command of the pass had been submitted, so the GPU can't
+// have been starved. This is a lower bound that is exact when the GPU runs behind the CPU. The
+// clock offset comes from the query results themselves, nothing asks the driver for the time.
+
+#pragma once
+
+#include <string>
+
+#include "Common/CommonTypes.h"
+
+namespace GPUTimer
+{
+enum class Pass : u32
+{
+  EFBDraw,      // game draws into the EFB
+  EFBCopy,      // work the renderer is asked for with the API state reset: EFB copies to
+                // textures and RAM, XFB copies, and the MSAA resolves they need
+  Resolve,      // MSAA resolves for EFB peeks
+  Reinterpret,  // EFB pixel format changes
+  Clear,
+  EFBPoke,
+  EFBPeek,
+  EFBPrefetch,
+  Present,      // BlitScreen into the host FBO
+  OSD,
+  FrameDump,
+  Count
+};
+
+// Beginning an open pass or ending a closed one is ignored. Any other pass pauses EFBDraw
+// while it is open, so the passes don't overlap and their work adds up.
+void Begin(Pass pass);
+void End(Pass pass);
+
+class ScopedPass
+{
+public:
+  explicit ScopedPass(Pass pass) : m_pass(pass) { Begin(pass); }
+  ~ScopedPass() { End(m_pass); }
+  ScopedPass(const ScopedPass&) = delete;
+  ScopedPass& operator=(const ScopedPass&) = delete;
+
+private:
+  Pass m_pass;
+};
+
+// Ends an open pass and begins it again. The work the GPU did on a pass while the CPU was still
+// submitting it isn't counted, so long passes are split to keep that part small.
+void Split(Pass pass);
+
+// Called once per frame after presenting. Passes still open continue into the next frame.
+void EndFrame(u64 frame_number);
+
+// Sum of the work measured in all passes of the frames resolved since the last call, and how
+// many frames that was. Returns false if none were.
+bool TakeBusyTime(u64* busy_ns, u32* frames);
+
+// Writes the recorded timeline (the last few hundred frames) as CSV.
+bool ExportTimeline(const std::string& path);
+
+// Releases the queries, exporting the timeline to the dump directory if timing was used.
+void Shutdown();
+}
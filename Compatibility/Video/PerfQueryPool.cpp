@@ -0,0 +1,314 @@
+// Copyright 2018 Dolphin Emulator Project
+// Licensed under GPLv2+
+// Refer to the license.txt file included.
+
+#include "PerfQueryPool.h"
+
+#include <array>
+#include <atomic>
+
+#include "Common/GL/GLUtil.h"
+#include "Common/Logging/Log.h"
+#include "Common/Timer.h"
+
+#include "VideoCommon/RenderBase.h"
+#include "VideoCommon/VideoCommon.h"
+#include "VideoCommon/VideoConfig.h"
+
+namespace PerfQueryPool
+{
+// when testing in SMS: 64 was too small, 128 was ok
+static constexpr u32 POOL_SIZE = 512;
+static constexpr u64 STATS_INTERVAL = 600;
+
+class PooledPerfQuery final : public PerfQueryBase
+{
+public:
+  PooledPerfQuery();
+  ~PooledPerfQuery();
+
+  void EnableQuery(PerfQueryGroup type) override;
+  void DisableQuery(PerfQueryGroup type) override;
+  void ResetQuery() override;
+  u32 GetQueryResult(PerfQueryType type) override;
+  void FlushResults() override;
+  bool IsFlushed() const override;
+
+  // Collects the queries that have completed, without waiting.
+  void Collect();
+  void LogStats(bool session);
+
+private:
+  struct ActiveQuery
+  {
+    GLuint query_id;
+    PerfQueryGroup group;
+    u32 period;
+    // Pixel counts are referenced to native resolution, with the scale the query was drawn at.
+    int target_width;
+    int target_height;
+  };
+
+  using Totals = std::array<std::atomic<u32>, PQG_NUM_MEMBERS>;
+
+  static void Clear(Totals& totals);
+  static u32 Result(const Totals& totals, PerfQueryType type);
+  void Resolve(bool wait);
+
+  std::array<ActiveQuery, POOL_SIZE> m_pool;
+  u32 m_read_pos = 0;
+  u32 m_count = 0;
+
+  // A counting period runs from one ResetQuery to the next. Queries of the previous period may
+  // still be in flight, older ones are dropped.
+  u32 m_period = 0;
+  Totals m_current;
+  Totals m_previous;
+  u32 m_previous_pending = 0;
+  std::atomic<u32> m_current_pending{0};
+
+  // Totals of the last period whose queries have all completed, for approximate reads.
+  Totals m_completed;
+  std::atomic<bool> m_have_completed{false};
+
+  // Written by the CPU thread on approximate reads, cleared by the GPU thread once the queries
+  // the read skipped have completed.
+  std::atomic<u64> m_skipped_since_us{0};
+
+  // Stats, the read counts are bumped on the CPU thread.
+  std::atomic<u32> m_reads{0};
+  std::atomic<u32> m_approximate_reads{0};
+  u32 m_blocking_flushes = 0;
+  u64 m_stall_us = 0;
+  u64 m_avoided_us = 0;
+  u32 m_dropped = 0;
+  u32 m_session_approximate_reads = 0;
+  u32 m_session_blocking_flushes = 0;
+  u64 m_session_stall_us = 0;
+  u64 m_session_avoided_us = 0;
+};
+
+static PooledPerfQuery* s_instance = nullptr;
+
+PooledPerfQuery::PooledPerfQuery()
+{
+  for (ActiveQuery& query : m_pool)
+    glGenQueries(1, &query.query_id);
+  Clear(m_current);
+  Clear(m_previous);
+  Clear(m_completed);
+  s_instance = this;
+}
+
+PooledPerfQuery::~PooledPerfQuery()
+{
+  LogStats(true);
+  for (ActiveQuery& query : m_pool)
+    glDeleteQueries(1, &query.query_id);
+  s_instance = nullptr;
+}
+
+void PooledPerfQuery::Clear(Totals& totals)
+{
+  for (std::atomic<u32>& total : totals)
+    total.store(0, std::memory_order_relaxed);
+}
+
+u32 PooledPerfQuery::Result(const Totals& totals, PerfQueryType type)
+{
+  u32 result = 0;
+  if (type == PQ_ZCOMP_INPUT_ZCOMPLOC || type == PQ_ZCOMP_OUTPUT_ZCOMPLOC)
+    result = totals[PQG_ZCOMP_ZCOMPLOC];
+  else if (type == PQ_ZCOMP_INPUT || type == PQ_ZCOMP_OUTPUT)
+    result = totals[PQG_ZCOMP];
+  else if (type == PQ_BLEND_INPUT)
+    result = totals[PQG_ZCOMP] + totals[PQG_ZCOMP_ZCOMPLOC];
+  else if (type == PQ_EFB_COPY_CLOCKS)
+    result = totals[PQG_EFB_COPY_CLOCKS];
+
+  return result / 4;
+}
+
+void PooledPerfQuery::EnableQuery(PerfQueryGroup type)
+{
+  if (m_count > POOL_SIZE / 2)
+    Collect();
+  // Only waits when the GPU is a whole pool of draws behind.
+  if (m_count == POOL_SIZE)
+  {
+    const u64 start_time = Common::Timer::GetTimeUs();
+    Resolve(true);
+    m_blocking_flushes++;
+    m_stall_us += Common::Timer::GetTimeUs() - start_time;
+  }
+
+  if (type == PQG_ZCOMP_ZCOMPLOC || type == PQG_ZCOMP)
+  {
+    ActiveQuery& entry = m_pool[(m_read_pos + m_count) % POOL_SIZE];
+    glBeginQuery(GL_SAMPLES_PASSED, entry.query_id);
+    entry.group = type;
+    entry.period = m_period;
+    entry.target_width = g_renderer->GetTargetWidth();
+    entry.target_height = g_renderer->GetTargetHeight();
+    m_count++;
+    m_current_pending++;
+  }
+}
+
+void PooledPerfQuery::DisableQuery(PerfQueryGroup type)
+{
+  if (type == PQG_ZCOMP_ZCOMPLOC || type == PQG_ZCOMP)
+    glEndQuery(GL_SAMPLES_PASSED);
+}
+
+void PooledPerfQuery::ResetQuery()
+{
+  // The period ending now completes once its queries do. One still pending from before that is
+  // given up on, it'll never be read.
+  if (m_previous_pending)
+    m_dropped++;
+
+  m_period++;
+  m_previous_pending = m_current_pending.exchange(0);
+  for (size_t i = 0; i < m_current.size(); ++i)
+    m_previous[i].store(m_current[i].exchange(0));
+
+  if (!m_previous_pending)
+  {
+    for (size_t i = 0; i < m_previous.size(); ++i)
+      m_completed[i].store(m_previous[i].load());
+    m_have_completed = true;
+  }
+}
+
+// Resolves the query at the read position, waiting for it or only if it's available.
+void PooledPerfQuery::Resolve(bool wait)
+{
+  const ActiveQuery& entry = m_pool[m_read_pos];
+  if (!wait)
+  {
+    GLuint available = GL_FALSE;
+    glGetQueryObjectuiv(entry.query_id, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      return;
+  }
+
+  GLuint result = 0;
+  glGetQueryObjectuiv(entry.query_id, GL_QUERY_RESULT, &result);
+  const u32 native = static_cast<u32>(static_cast<u64>(result) * EFB_WIDTH / entry.target_width *
+                                      EFB_HEIGHT / entry.target_height);
+
+  if (entry.period == m_period)
+  {
+    m_current[entry.group] += native;
+    m_current_pending--;
+  }
+  else if (entry.period + 1 == m_period && m_previous_pending)
+  {
+    m_previous[entry.group] += native;
+    if (--m_previous_pending == 0)
+    {
+      for (size_t i = 0; i < m_previous.size(); ++i)
+        m_completed[i].store(m_previous[i].load());
+      m_have_completed = true;
+    }
+  }
+
+  m_read_pos = (m_read_pos + 1) % POOL_SIZE;
+  m_count--;
+}
+
+void PooledPerfQuery::Collect()
+{
+  while (m_count)
+  {
+    const u32 count = m_count;
+    Resolve(false);
+    if (m_count == count)
+      break;
+  }
+
+  // Everything a skipped read would have waited for has now completed.
+  const u64 skipped_since = m_skipped_since_us.exchange(0);
+  if (skipped_since && !m_current_pending)
+    m_avoided_us += Common::Timer::GetTimeUs() - skipped_since;
+  else if (skipped_since)
+    m_skipped_since_us = skipped_since;
+}
+
+void PooledPerfQuery::FlushResults()
+{
+  if (!m_count)
+    return;
+
+  const u64 start_time = Common::Timer::GetTimeUs();
+  while (m_count)
+    Resolve(true);
+  m_blocking_flushes++;
+  m_stall_us += Common::Timer::GetTimeUs() - start_time;
+}
+
+bool PooledPerfQuery::IsFlushed() const
+{
+  // Approximate reads never make the CPU thread wait for the GPU thread to flush.
+  return g_ActiveConfig.bPerfQueriesApproximate || m_current_pending == 0;
+}
+
+// Called on the CPU thread.
+u32 PooledPerfQuery::GetQueryResult(PerfQueryType type)
+{
+  m_reads++;
+  if (m_current_pending == 0 || !g_ActiveConfig.bPerfQueriesApproximate)
+    return Result(m_current, type);
+
+  m_approximate_reads++;
+  u64 expected = 0;
+  m_skipped_since_us.compare_exchange_strong(expected, Common::Timer::GetTimeUs());
+  return Result(m_have_completed ? m_completed : m_current, type);
+}
+
+void PooledPerfQuery::LogStats(bool session)
+{
+  const u32 reads = m_reads.exchange(0);
+  const u32 approximate_reads = m_approximate_reads.exchange(0);
+  m_session_approximate_reads += approximate_reads;
+  m_session_blocking_flushes += m_blocking_flushes;
+  m_session_stall_us += m_stall_us;
+  m_session_avoided_us += m_avoided_us;
+
+  if (session && m_session_approximate_reads + m_session_blocking_flushes)
+  {
+    NOTICE_LOG(VIDEO, "Perf queries: %u blocking flushes (%.1f ms stalled), %u approximate reads "
+                      "(~%.1f ms of waiting avoided) this session",
+               m_session_blocking_flushes, m_session_stall_us / 1000.0,
+               m_session_approximate_reads, m_session_avoided_us / 1000.0);
+  }
+  else if (!session && reads)
+  {
+    INFO_LOG(VIDEO, "Perf queries: %u reads, %u blocking flushes (%.2f ms stalled), %u "
+                    "approximate (~%.2f ms avoided), %u periods dropped over %u frames",
+             reads, m_blocking_flushes, m_stall_us / 1000.0, approximate_reads,
+             m_avoided_us / 1000.0, m_dropped, static_cast<u32>(STATS_INTERVAL));
+  }
+
+  m_blocking_flushes = 0;
+  m_stall_us = 0;
+  m_avoided_us = 0;
+  m_dropped = 0;
+}
+
+std::unique_ptr<PerfQueryBase> Create()
+{
+  return std::make_unique<PooledPerfQuery>();
+}
+
+void EndFrame(u64 frame_number)
+{
+  if (!s_instance)
+    return;
+
+  s_instance->Collect();
+  if (frame_number % STATS_INTERVAL == 0)
+    s_instance->LogStats(false);
+}
+}
@@ -0,0 +1,26 @@
+// Copyright 2018 Dolphin Emulator Project
+// Licensed under GPLv2+
+// Refer to the license.txt file included.
+
+// Occlusion query backed PE performance counters. Queries come from a ring and are collected
+// without blocking as they complete, whenever the ring runs half full and once per frame. A
+// read of counters with queries still in flight waits for them, unless bPerfQueriesApproximate
+// is set: then it gets the totals of the last completed counting period (the counters are reset
+// by the game, usually every frame) and the GPU is never waited on.
+
+#pragma once
+
+#include <memory>
+
+#include "Common/CommonTypes.h"
+
+#include "VideoCommon/PerfQueryBase.h"
+
+namespace PerfQueryPool
+{
+// Replaces the backend's implementation, installed by the renderer.
+std::unique_ptr<PerfQueryBase> Create();
+
+// Called once per frame by the renderer. Collects completed queries and logs the stall time.
+void EndFrame(u64 frame_number);
+}
@@ -5,12 +5,15 @@
 #include "VideoBackends/OGL/Render.h"
 
 #include <algorithm>
+#include <chrono>
 #include <cinttypes>
 #include <cmath>
 #include <cstdio>
+#include <deque>
 #include <memory>
 #include <string>
 #include <tuple>
+#include <type_traits>
 #include <vector>
 
 #include "Common/Assert.h"
@@ -18,10 +21,12 @@
 #include "Common/CommonTypes.h"
 #include "Common/GL/GLInterfaceBase.h"
 #include "Common/GL/GLUtil.h"
+#include "Common/Intrinsics.h"
 #include "Common/Logging/LogManager.h"
 #include "Common/MathUtil.h"
 #include "Common/MsgHandler.h"
 #include "Common/StringUtil.h"
+#include "Common/Timer.h"
 
 #include "Core/Config/GraphicsSettings.h"
 #include "Core/Core.h"
@@ -40,6 +45,7 @@
 #include "VideoBackends/OGL/VertexManager.h"
 
 #include "VideoCommon/BPFunctions.h"
+#include "VideoCommon/BoundingBox.h"
 #include "VideoCommon/DriverDetails.h"
 #include "VideoCommon/IndexGenerator.h"
 #include "VideoCommon/OnScreenDisplay.h"
@@ -51,6 +57,19 @@
 #include "VideoCommon/VideoConfig.h"
 #include "VideoCommon/XFMemory.h"
 
+#include "Common/TextureHash.h"
+
+#include "AdaptiveShaderCompilation.h"
+#include "DynamicResolution.h"
+#include "FrameDump.h"
+#include "FrameHash.h"
+#include "GLStateTracker.h"
+#include "GPUTimer.h"
+#include "PerfQueryPool.h"
+#include "ShaderCacheBundle.h"
+#include "TextureMemory.h"
+#include "TextureUpload.h"
+
 namespace OGL
 {
     VideoConfig g_ogl_config;
@@ -76,6 +95,69 @@ namespace OGL
     static std::vector<u32>
     s_efbCache[2][EFB_CACHE_WIDTH * EFB_CACHE_HEIGHT];  // 2 for PeekZ and PeekColor
     
+    // EFB peek prefetching (bEFBAccessPrefetch). Tiles that were peeked are read back into pixel
+    // buffer objects when the EFB copy that ends their frame clears them, just before the clear,
+    // and the next peek of such a tile is served from the buffer instead of stalling on
+    // glReadPixels. That data is up to a frame old, which is why this is opt-in. A later clear
+    // of the tile discards it, the EFB no longer holds anything like it.
+    struct EFBPrefetchTile
+    {
+        GLuint buffer = 0;
+        GLsync fence = nullptr;
+        EFBRectangle efb_rect;
+        TargetRectangle target_rect;
+    };
+    static EFBPrefetchTile s_efbPrefetch[2][EFB_CACHE_WIDTH * EFB_CACHE_HEIGHT];
+    static bool s_efbPeeked[2][EFB_CACHE_WIDTH * EFB_CACHE_HEIGHT];
+    
+    // Peek statistics, reported every EFB_PEEK_STATS_INTERVAL frames.
+    static const u64 EFB_PEEK_STATS_INTERVAL = 600;
+    static u32 s_efbPeekCount = 0;
+    static u32 s_efbPeekPrefetchHits = 0;
+    static u32 s_efbPeekReadbacks = 0;
+    static u64 s_efbPeekStallUs = 0;
+    static u32 s_efbTileConversions = 0;
+    static u64 s_efbTileConversionNs = 0;
+    
+    // EFB pokes are queued and drawn in one batch per type before the EFB is next used, while
+    // the peek cache is updated in place. 0 for PokeZ, 1 for PokeColor.
+    static std::vector<EfbPokeData> s_efbPokes[2];
+    static bool s_efbPokeFlushing = false;
+    
+    // GPU timer pass for the work done with the API state reset. Upstream only resets it for EFB
+    // copies; the renderer's own callers name their pass while they hold the state reset, and
+    // Count leaves the work untimed.
+    static GPUTimer::Pass s_resetPass = GPUTimer::Pass::EFBCopy;
+    static GPUTimer::Pass s_openResetPass = GPUTimer::Pass::Count;
+    
+    class ScopedResetPass
+    {
+    public:
+        explicit ScopedResetPass(GPUTimer::Pass pass) : m_previous(s_resetPass) { s_resetPass = pass; }
+        ~ScopedResetPass() { s_resetPass = m_previous; }
+        ScopedResetPass(const ScopedResetPass&) = delete;
+        ScopedResetPass& operator=(const ScopedResetPass&) = delete;
+        
+    private:
+        GPUTimer::Pass m_previous;
+    };
+    
+    // Bounding box values as the backend returned them, fetched all four at once on the first
+    // read after a draw that could have changed them.
+    static int s_bboxCache[4];
+    static bool s_bboxCacheValid = false;
+    static u32 s_bboxReads = 0;
+    static u32 s_bboxReadbacks = 0;
+    static u64 s_bboxStallUs = 0;
+    
+    // Draws per GPU timer interval in the EFB draw pass.
+    static const u32 DRAW_TIMER_CHUNK = 16;
+    static u32 s_timedDraws = 0;
+    
+    // g_ActiveConfig is refreshed only when g_Config's generation changes. Every writer calls
+    // MarkChanged; DolHost bumps it after upstream's Refresh.
+    static u32 s_configReconfigurations = 0;
+    
     static void APIENTRY ErrorCallback(GLenum source, GLenum type, GLuint id, GLenum severity,
                                        GLsizei length, const char* message, const void* userParam)
     {
@@ -359,6 +441,9 @@ namespace OGL
     {
         bool bSuccess = true;
         
+        // Shader compiles on any other thread happen in the background.
+        AdaptiveShaderCompilation::SetRenderThread();
+        
         g_ogl_config.gl_vendor = (const char*)glGetString(GL_VENDOR);
         g_ogl_config.gl_renderer = (const char*)glGetString(GL_RENDERER);
         g_ogl_config.gl_version = (const char*)glGetString(GL_VERSION);
@@ -796,16 +881,42 @@ namespace OGL
             GLUtil::EnablePrimitiveRestart();
         IndexGenerator::Init();
         
+        // The state above was set directly.
+        GLStateTracker::Invalidate();
+        
         UpdateActiveConfig();
         ClearEFBCache();
+        
+        // Before the shader cache opens its files.
+        ShaderCacheBundle::Import(g_ActiveConfig.sShaderCacheBundleImportPath);
     }
     
-    Renderer::~Renderer() = default;
+    Renderer::~Renderer()
+    {
+        // The shader cache has closed its files by now.
+        ShaderCacheBundle::Export(g_ActiveConfig.sShaderCacheBundleExportPath);
+    }
     
     void Renderer::Shutdown()
     {
         ::Renderer::Shutdown();
+        s_efbPokes[0].clear();
+        s_efbPokes[1].clear();
         g_framebuffer_manager.reset();
+        AdaptiveShaderCompilation::Reset();
+        DynamicResolution::Reset();
+        DestroyEFBPrefetch();
+        DestroyFrameDumpReadbacks();
+        DestroyPresentQueue();
+        TextureUpload::Shutdown();
+        TextureMemory::Shutdown();
+        GPUTimer::Shutdown();
+        GLStateTracker::Invalidate();
+        s_bboxCacheValid = false;
+        
+        NOTICE_LOG(VIDEO, "Config: %u reconfigurations this session (generation %u)",
+                   s_configReconfigurations, g_Config.iGeneration);
+        s_configReconfigurations = 0;
         
         UpdateActiveConfig();
         
@@ -823,11 +934,18 @@ namespace OGL
         
         m_post_processor = std::make_unique<OpenGLPostProcessing>();
         s_raster_font = std::make_unique<RasterFont>();
+        
+        // The backend has created its perf query by now, swap in the pooled one.
+        g_perf_query = PerfQueryPool::Create();
+        
+        TextureHash::SetVerify(g_ActiveConfig.bVerifyTextureHashes);
+        if (g_ActiveConfig.bTextureHashBenchmark)
+            TextureHash::RunBenchmark(g_ActiveConfig.iSafeTextureCache_ColorSamples);
     }
     
     std::unique_ptr<AbstractTexture> Renderer::CreateTexture(const TextureConfig& config)
     {
-        return std::make_unique<OGLTexture>(config);
+        return TextureUpload::CreateTexture(config);
     }
     
     std::unique_ptr<AbstractStagingTexture> Renderer::CreateStagingTexture(StagingTextureType type,
@@ -862,7 +980,11 @@ namespace OGL
     std::unique_ptr<AbstractShader> Renderer::CreateShaderFromSource(ShaderStage stage,
                                                                      const char* source, size_t length)
     {
-        return OGLShader::CreateFromSource(stage, source, length);
+        const u64 start_time = Common::Timer::GetTimeUs();
+        std::unique_ptr<AbstractShader> shader = OGLShader::CreateFromSource(stage, source, length);
+        const u64 elapsed_us = Common::Timer::GetTimeUs() - start_time;
+        AdaptiveShaderCompilation::RecordCompile(elapsed_us);
+        return shader;
     }
     
     std::unique_ptr<AbstractShader> Renderer::CreateShaderFromBinary(ShaderStage stage,
@@ -873,7 +995,12 @@ namespace OGL
     
     std::unique_ptr<AbstractPipeline> Renderer::CreatePipeline(const AbstractPipelineConfig& config)
     {
-        return OGLPipeline::Create(config);
+        const u64 start_time = Common::Timer::GetTimeUs();
+        std::unique_ptr<AbstractPipeline> pipeline = OGLPipeline::Create(config);
+        const u64 elapsed_us = Common::Timer::GetTimeUs() - start_time;
+        AdaptiveShaderCompilation::RecordCompile(elapsed_us);
+        AdaptiveShaderCompilation::RecordPipelineCreated();
+        return pipeline;
     }
     
     TargetRectangle Renderer::ConvertEFBRectangle(const EFBRectangle& rc)
@@ -888,11 +1015,15 @@ namespace OGL
     
     void Renderer::SetScissorRect(const MathUtil::Rectangle<int>& rc)
     {
-        glScissor(rc.left, rc.bottom, rc.GetWidth(), rc.GetHeight());
+        GLStateTracker::SetScissor(rc.left, rc.bottom, rc.GetWidth(), rc.GetHeight());
     }
     
     void ClearEFBCache()
     {
+        // Flushing queued pokes doesn't invalidate anything, the cache already has their values.
+        if (s_efbPokeFlushing)
+            return;
+        
         if (!s_efbCacheIsCleared)
         {
             s_efbCacheIsCleared = true;
@@ -900,6 +1031,212 @@ namespace OGL
         }
     }
     
+    static void FlushEFBPokes()
+    {
+        if (s_efbPokeFlushing)
+            return;
+        
+        s_efbPokeFlushing = true;
+        ScopedResetPass timer(GPUTimer::Pass::EFBPoke);
+        if (!s_efbPokes[0].empty())
+        {
+            FramebufferManager::PokeEFB(EFBAccessType::PokeZ, s_efbPokes[0].data(), s_efbPokes[0].size());
+            s_efbPokes[0].clear();
+        }
+        if (!s_efbPokes[1].empty())
+        {
+            FramebufferManager::PokeEFB(EFBAccessType::PokeColor, s_efbPokes[1].data(),
+                                        s_efbPokes[1].size());
+            s_efbPokes[1].clear();
+        }
+        s_efbPokeFlushing = false;
+    }
+    
+    static void ReadEFBPixels(EFBAccessType type, const TargetRectangle& rc, void* data)
+    {
+        GPUTimer::ScopedPass timer(data ? GPUTimer::Pass::EFBPeek : GPUTimer::Pass::EFBPrefetch);
+        GLsizei width = rc.right - rc.left;
+        GLsizei height = rc.top - rc.bottom;
+        if (type == EFBAccessType::PeekZ)
+            glReadPixels(rc.left, rc.bottom, width, height, GL_DEPTH_COMPONENT, GL_FLOAT, data);
+        else if (GLInterface->GetMode() == GLInterfaceMode::MODE_OPENGLES3)
+            // XXX: Swap colours
+            glReadPixels(rc.left, rc.bottom, width, height, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        else
+            glReadPixels(rc.left, rc.bottom, width, height, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, data);
+    }
+    
+    static void DiscardEFBPrefetchTile(EFBPrefetchTile& tile)
+    {
+        if (tile.fence)
+        {
+            glDeleteSync(tile.fence);
+            tile.fence = nullptr;
+        }
+    }
+    
+    static void DiscardEFBPrefetch()
+    {
+        for (auto& tiles : s_efbPrefetch)
+        {
+            for (EFBPrefetchTile& tile : tiles)
+                DiscardEFBPrefetchTile(tile);
+        }
+    }
+    
+    static void DestroyEFBPrefetch()
+    {
+        DiscardEFBPrefetch();
+        for (auto& tiles : s_efbPrefetch)
+        {
+            for (EFBPrefetchTile& tile : tiles)
+            {
+                if (tile.buffer)
+                {
+                    glDeleteBuffers(1, &tile.buffer);
+                    tile.buffer = 0;
+                }
+            }
+        }
+        memset(s_efbPeeked, 0, sizeof(s_efbPeeked));
+    }
+    
+    // Calls f(cacheType, cacheRectIdx) for the tiles of the given types that rc overlaps.
+    template <typename F>
+    static void ForEachEFBTile(const EFBRectangle& rc, bool color, bool depth, F f)
+    {
+        if (rc.right <= std::max(rc.left, 0) || rc.bottom <= std::max(rc.top, 0))
+            return;
+        
+        const u32 left = static_cast<u32>(std::max(rc.left, 0)) / EFB_CACHE_RECT_SIZE;
+        const u32 top = static_cast<u32>(std::max(rc.top, 0)) / EFB_CACHE_RECT_SIZE;
+        const u32 right =
+        std::min(static_cast<u32>(rc.right - 1) / EFB_CACHE_RECT_SIZE, EFB_CACHE_WIDTH - 1);
+        const u32 bottom =
+        std::min(static_cast<u32>(rc.bottom - 1) / EFB_CACHE_RECT_SIZE, EFB_CACHE_HEIGHT - 1);
+        for (u32 cacheType = depth ? 0 : 1; cacheType < (color ? 2u : 1u); ++cacheType)
+        {
+            for (u32 y = top; y <= bottom; ++y)
+            {
+                for (u32 x = left; x <= right; ++x)
+                    f(cacheType, y * EFB_CACHE_WIDTH + x);
+            }
+        }
+    }
+    
+    // Called by ClearScreen before it clears rc, which is where EFB copies clear what they copied.
+    // Queues readbacks of the peeked tiles about to be cleared and drops earlier readbacks of the
+    // other tiles there, which would otherwise outlive a second clear.
+    static void PrefetchEFBTiles(const EFBRectangle& rc, bool color, bool depth)
+    {
+        bool reset = false;
+        ForEachEFBTile(rc, color, depth, [&reset](u32 cacheType, u32 cacheRectIdx) {
+            EFBPrefetchTile& tile = s_efbPrefetch[cacheType][cacheRectIdx];
+            DiscardEFBPrefetchTile(tile);
+            if (!s_efbPeeked[cacheType][cacheRectIdx])
+                return;
+            s_efbPeeked[cacheType][cacheRectIdx] = false;
+            
+            if (!reset)
+            {
+                // The readbacks are timed by ReadEFBPixels, the state reset around them isn't.
+                ScopedResetPass timer(GPUTimer::Pass::Count);
+                g_renderer->ResetAPIState();
+                reset = true;
+            }
+            
+            const EFBAccessType type = cacheType == 0 ? EFBAccessType::PeekZ : EFBAccessType::PeekColor;
+            tile.efb_rect.left = (cacheRectIdx % EFB_CACHE_WIDTH) * EFB_CACHE_RECT_SIZE;
+            tile.efb_rect.top = (cacheRectIdx / EFB_CACHE_WIDTH) * EFB_CACHE_RECT_SIZE;
+            tile.efb_rect.right = std::min(tile.efb_rect.left + EFB_CACHE_RECT_SIZE, (u32)EFB_WIDTH);
+            tile.efb_rect.bottom = std::min(tile.efb_rect.top + EFB_CACHE_RECT_SIZE, (u32)EFB_HEIGHT);
+            tile.target_rect = g_renderer->ConvertEFBRectangle(tile.efb_rect);
+            
+            if (s_MSAASamples > 1)
+            {
+                // Resolve our rectangle.
+                if (type == EFBAccessType::PeekZ)
+                    FramebufferManager::GetEFBDepthTexture(tile.efb_rect);
+                else
+                    FramebufferManager::GetEFBColorTexture(tile.efb_rect);
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, FramebufferManager::GetResolvedFramebuffer());
+            }
+            else
+            {
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, FramebufferManager::GetEFBFramebuffer());
+            }
+            
+            if (!tile.buffer)
+                glGenBuffers(1, &tile.buffer);
+            const u32 size = (tile.target_rect.right - tile.target_rect.left) *
+            (tile.target_rect.top - tile.target_rect.bottom) * sizeof(u32);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, tile.buffer);
+            glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+            ReadEFBPixels(type, tile.target_rect, nullptr);
+            tile.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        });
+        
+        if (reset)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            g_renderer->RestoreAPIState();
+        }
+    }
+    
+    // Target pixel sampled for each EFB row and column, rebuilt when the target size changes.
+    static std::vector<u32> s_efbRowPixels;
+    static std::vector<u32> s_efbColumnPixels;
+    static int s_efbPixelTableWidth = 0;
+    static int s_efbPixelTableHeight = 0;
+    
+    // Converts a row of depth values to the 24-bit integers the EFB peek returns.
+    static void ConvertEFBDepthRow(u32* dst, const float* src, u32 count)
+    {
+        u32 i = 0;
+#ifdef _M_X86
+        const __m128 scale = _mm_set1_ps(16777216.0f);
+        const __m128 max_value = _mm_set1_ps(16777215.0f);
+        for (; i + 4 <= count; i += 4)
+        {
+            __m128 value = _mm_mul_ps(_mm_loadu_ps(src + i), scale);
+            value = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), max_value);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_cvttps_epi32(value));
+        }
+#endif
+        for (; i < count; ++i)
+            dst[i] = MathUtil::Clamp<u32>(static_cast<u32>(src[i] * 16777216.0f), 0, 0xFFFFFF);
+    }
+    
+    template <EFBAccessType type>
+    static void ConvertEFBTile(u32* dst, const void* data, u32 stride, const u32* rows,
+                               const u32* columns, u32 width, u32 height)
+    {
+        using SourceType = typename std::conditional<type == EFBAccessType::PeekZ, float, u32>::type;
+        const SourceType* src = static_cast<const SourceType*>(data);
+        
+        // At 1x the columns are adjacent and rows can be converted in place.
+        const bool contiguous = columns[width - 1] - columns[0] == width - 1;
+        SourceType gathered[EFB_CACHE_RECT_SIZE];
+        
+        for (u32 yCache = 0; yCache < height; ++yCache)
+        {
+            const SourceType* line = src + rows[yCache] * stride;
+            const SourceType* row = line + columns[0];
+            if (!contiguous)
+            {
+                for (u32 xCache = 0; xCache < width; ++xCache)
+                    gathered[xCache] = line[columns[xCache]];
+                row = gathered;
+            }
+            
+            u32* out = dst + yCache * EFB_CACHE_RECT_SIZE;
+            if (type == EFBAccessType::PeekZ)
+                ConvertEFBDepthRow(out, reinterpret_cast<const float*>(row), width);
+            else
+                memcpy(out, row, width * sizeof(u32));
+        }
+    }
+    
     void Renderer::UpdateEFBCache(EFBAccessType type, u32 cacheRectIdx, const EFBRectangle& efbPixelRc,
                                   const TargetRectangle& targetPixelRc, const void* data)
     {
@@ -908,36 +1245,42 @@ namespace OGL
         if (!s_efbCache[cacheType][cacheRectIdx].size())
             s_efbCache[cacheType][cacheRectIdx].resize(EFB_CACHE_RECT_SIZE * EFB_CACHE_RECT_SIZE);
         
+        if (s_efbPixelTableWidth != m_target_width || s_efbPixelTableHeight != m_target_height)
+        {
+            s_efbPixelTableWidth = m_target_width;
+            s_efbPixelTableHeight = m_target_height;
+            s_efbColumnPixels.resize(EFB_WIDTH);
+            for (u32 xEFB = 0; xEFB < EFB_WIDTH; ++xEFB)
+                s_efbColumnPixels[xEFB] = (EFBToScaledX(xEFB) + EFBToScaledX(xEFB + 1)) / 2;
+            s_efbRowPixels.resize(EFB_HEIGHT);
+            for (u32 yEFB = 0; yEFB < EFB_HEIGHT; ++yEFB)
+                s_efbRowPixels[yEFB] = (EFBToScaledY(EFB_HEIGHT - yEFB) + EFBToScaledY(EFB_HEIGHT - yEFB - 1)) / 2;
+        }
+        
         u32 targetPixelRcWidth = targetPixelRc.right - targetPixelRc.left;
         u32 efbPixelRcHeight = efbPixelRc.bottom - efbPixelRc.top;
         u32 efbPixelRcWidth = efbPixelRc.right - efbPixelRc.left;
         
+        u32 rows[EFB_CACHE_RECT_SIZE];
+        u32 columns[EFB_CACHE_RECT_SIZE];
         for (u32 yCache = 0; yCache < efbPixelRcHeight; ++yCache)
-        {
-            u32 yEFB = efbPixelRc.top + yCache;
-            u32 yPixel = (EFBToScaledY(EFB_HEIGHT - yEFB) + EFBToScaledY(EFB_HEIGHT - yEFB - 1)) / 2;
-            u32 yData = yPixel - targetPixelRc.bottom;
-            
-            for (u32 xCache = 0; xCache < efbPixelRcWidth; ++xCache)
-            {
-                u32 xEFB = efbPixelRc.left + xCache;
-                u32 xPixel = (EFBToScaledX(xEFB) + EFBToScaledX(xEFB + 1)) / 2;
-                u32 xData = xPixel - targetPixelRc.left;
-                u32 value;
-                if (type == EFBAccessType::PeekZ)
-                {
-                    float* ptr = (float*)data;
-                    value = MathUtil::Clamp<u32>((u32)(ptr[yData * targetPixelRcWidth + xData] * 16777216.0f),
-                                                 0, 0xFFFFFF);
-                }
-                else
-                {
-                    u32* ptr = (u32*)data;
-                    value = ptr[yData * targetPixelRcWidth + xData];
-                }
-                s_efbCache[cacheType][cacheRectIdx][yCache * EFB_CACHE_RECT_SIZE + xCache] = value;
-            }
-        }
+            rows[yCache] = s_efbRowPixels[efbPixelRc.top + yCache] - targetPixelRc.bottom;
+        for (u32 xCache = 0; xCache < efbPixelRcWidth; ++xCache)
+            columns[xCache] = s_efbColumnPixels[efbPixelRc.left + xCache] - targetPixelRc.left;
+        
+        // A tile converts in well under a microsecond, so it's timed with the high resolution
+        // clock and only the conversion itself, not the table setup above.
+        const auto start_time = std::chrono::steady_clock::now();
+        u32* dst = s_efbCache[cacheType][cacheRectIdx].data();
+        if (type == EFBAccessType::PeekZ)
+            ConvertEFBTile<EFBAccessType::PeekZ>(dst, data, targetPixelRcWidth, rows, columns,
+                                                 efbPixelRcWidth, efbPixelRcHeight);
+        else
+            ConvertEFBTile<EFBAccessType::PeekColor>(dst, data, targetPixelRcWidth, rows, columns,
+                                                     efbPixelRcWidth, efbPixelRcHeight);
+        s_efbTileConversionNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_time).count();
+        s_efbTileConversions++;
         
         s_efbCacheValid[cacheType][cacheRectIdx] = true;
         s_efbCacheIsCleared = false;
@@ -983,6 +1326,45 @@ namespace OGL
         u32 targetPixelRcWidth = targetPixelRc.right - targetPixelRc.left;
         u32 targetPixelRcHeight = targetPixelRc.top - targetPixelRc.bottom;
         
+        if (type == EFBAccessType::PeekColor || type == EFBAccessType::PeekZ)
+        {
+            const u32 cacheType = (type == EFBAccessType::PeekZ ? 0 : 1);
+            s_efbPeekCount++;
+            if (g_ActiveConfig.bEFBAccessPrefetch)
+                s_efbPeeked[cacheType][cacheRectIdx] = true;
+            
+            // Serve the miss from last frame's readback of this tile, if there is one.
+            EFBPrefetchTile& tile = s_efbPrefetch[cacheType][cacheRectIdx];
+            if (!s_efbCacheValid[cacheType][cacheRectIdx] && tile.fence)
+            {
+                u64 start_time = Common::Timer::GetTimeUs();
+                glClientWaitSync(tile.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+                glDeleteSync(tile.fence);
+                tile.fence = nullptr;
+                
+                const u32 size = (tile.target_rect.right - tile.target_rect.left) *
+                (tile.target_rect.top - tile.target_rect.bottom) * sizeof(u32);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, tile.buffer);
+                const void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, size, GL_MAP_READ_BIT);
+                if (data)
+                {
+                    UpdateEFBCache(type, cacheRectIdx, tile.efb_rect, tile.target_rect, data);
+                    s_efbPeekPrefetchHits++;
+                }
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+                s_efbPeekStallUs += Common::Timer::GetTimeUs() - start_time;
+            }
+            
+            if (!s_efbCacheValid[cacheType][cacheRectIdx])
+            {
+                s_efbPeekReadbacks++;
+                
+                // The readback has to see any pokes still in the queue.
+                FlushEFBPokes();
+            }
+        }
+        
         // TODO (FIX) : currently, AA path is broken/offset and doesn't return the correct pixel
         switch (type)
         {
@@ -992,6 +1374,7 @@ namespace OGL
                 {
                     if (s_MSAASamples > 1)
                     {
+                        ScopedResetPass timer(GPUTimer::Pass::Resolve);
                         ResetAPIState();
                         
                         // Resolve our rectangle.
@@ -1003,8 +1386,9 @@ namespace OGL
                     
                     std::unique_ptr<float[]> depthMap(new float[targetPixelRcWidth * targetPixelRcHeight]);
                     
-                    glReadPixels(targetPixelRc.left, targetPixelRc.bottom, targetPixelRcWidth,
-                                 targetPixelRcHeight, GL_DEPTH_COMPONENT, GL_FLOAT, depthMap.get());
+                    u64 start_time = Common::Timer::GetTimeUs();
+                    ReadEFBPixels(type, targetPixelRc, depthMap.get());
+                    s_efbPeekStallUs += Common::Timer::GetTimeUs() - start_time;
                     
                     UpdateEFBCache(type, cacheRectIdx, efbPixelRc, targetPixelRc, depthMap.get());
                 }
@@ -1031,6 +1415,7 @@ namespace OGL
                 {
                     if (s_MSAASamples > 1)
                     {
+                        ScopedResetPass timer(GPUTimer::Pass::Resolve);
                         ResetAPIState();
                         
                         // Resolve our rectangle.
@@ -1042,13 +1427,9 @@ namespace OGL
                     
                     std::unique_ptr<u32[]> colorMap(new u32[targetPixelRcWidth * targetPixelRcHeight]);
                     
-                    if (GLInterface->GetMode() == GLInterfaceMode::MODE_OPENGLES3)
-                        // XXX: Swap colours
-                        glReadPixels(targetPixelRc.left, targetPixelRc.bottom, targetPixelRcWidth,
-                                     targetPixelRcHeight, GL_RGBA, GL_UNSIGNED_BYTE, colorMap.get());
-                    else
-                        glReadPixels(targetPixelRc.left, targetPixelRc.bottom, targetPixelRcWidth,
-                                     targetPixelRcHeight, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, colorMap.get());
+                    u64 start_time = Common::Timer::GetTimeUs();
+                    ReadEFBPixels(type, targetPixelRc, colorMap.get());
+                    s_efbPeekStallUs += Common::Timer::GetTimeUs() - start_time;
                     
                     UpdateEFBCache(type, cacheRectIdx, efbPixelRc, targetPixelRc, colorMap.get());
                 }
@@ -1098,7 +1479,31 @@ namespace OGL
     
     void Renderer::PokeEFB(EFBAccessType type, const EfbPokeData* points, size_t num_points)
     {
-        FramebufferManager::PokeEFB(type, points, num_points);
+        const u32 cacheType = (type == EFBAccessType::PokeZ ? 0 : 1);
+        s_efbPokes[cacheType].insert(s_efbPokes[cacheType].end(), points, points + num_points);
+        
+        // Keep cached tiles valid by writing the poked values straight into them.
+        for (size_t i = 0; i < num_points; ++i)
+        {
+            const EfbPokeData& point = points[i];
+            u32 cacheRectIdx = (point.y / EFB_CACHE_RECT_SIZE) * EFB_CACHE_WIDTH + (point.x / EFB_CACHE_RECT_SIZE);
+            
+            // A prefetched copy of the tile predates the poke.
+            EFBPrefetchTile& tile = s_efbPrefetch[cacheType][cacheRectIdx];
+            if (tile.fence)
+            {
+                glDeleteSync(tile.fence);
+                tile.fence = nullptr;
+            }
+            
+            if (!s_efbCacheValid[cacheType][cacheRectIdx])
+                continue;
+            
+            u32 xRect = point.x % EFB_CACHE_RECT_SIZE;
+            u32 yRect = point.y % EFB_CACHE_RECT_SIZE;
+            s_efbCache[cacheType][cacheRectIdx][yRect * EFB_CACHE_RECT_SIZE + xRect] =
+            type == EFBAccessType::PokeZ ? point.data & 0xFFFFFF : point.data;
+        }
     }
     
     u16 Renderer::BBoxRead(int index)
@@ -1107,10 +1512,22 @@ namespace OGL
         if (index >= 2)
             swapped_index ^= 1;  // swap 2 and 3 for top/bottom
         
+        // Games read all four values back to back, so pay for the GPU sync once.
+        s_bboxReads++;
+        if (!s_bboxCacheValid)
+        {
+            u64 start_time = Common::Timer::GetTimeUs();
+            for (int i = 0; i < 4; ++i)
+                s_bboxCache[i] = BoundingBox::Get(i);
+            s_bboxCacheValid = true;
+            s_bboxReadbacks++;
+            s_bboxStallUs += Common::Timer::GetTimeUs() - start_time;
+        }
+        
         // Here we get the min/max value of the truncated position of the upscaled and swapped
         // framebuffer.
         // So we have to correct them to the unscaled EFB sizes.
-        int value = BoundingBox::Get(swapped_index);
+        int value = s_bboxCache[swapped_index];
         
         if (index < 2)
         {
@@ -1146,6 +1563,7 @@ namespace OGL
         }
         
         BoundingBox::Set(index, value);
+        s_bboxCache[index] = value;
     }
     
     void Renderer::SetViewport(float x, float y, float width, float height, float near_depth,
@@ -1156,20 +1574,24 @@ namespace OGL
         y = static_cast<float>(m_current_framebuffer_height) - y - height;
         if (g_ogl_config.bSupportViewportFloat)
         {
-            glViewportIndexedf(0, x, y, width, height);
+            GLStateTracker::SetViewport(x, y, width, height);
         }
         else
         {
             auto iceilf = [](float f) { return static_cast<GLint>(std::ceil(f)); };
-            glViewport(iceilf(x), iceilf(y), iceilf(width), iceilf(height));
+            GLStateTracker::SetViewport(iceilf(x), iceilf(y), iceilf(width), iceilf(height));
         }
         
-        glDepthRangef(near_depth, far_depth);
+        GLStateTracker::SetDepthRange(near_depth, far_depth);
     }
     
     void Renderer::ClearScreen(const EFBRectangle& rc, bool colorEnable, bool alphaEnable, bool zEnable,
                                u32 color, u32 z)
     {
+        if (g_ActiveConfig.bEFBAccessPrefetch)
+            PrefetchEFBTiles(rc, colorEnable || alphaEnable, zEnable);
+        
+        ScopedResetPass timer(GPUTimer::Pass::Clear);
         ResetAPIState();
         
         // color
@@ -1237,6 +1659,7 @@ namespace OGL
     {
         if (convtype == 0 || convtype == 2)
         {
+            ScopedResetPass timer(GPUTimer::Pass::Reinterpret);
             FramebufferManager::ReinterpretPixelData(convtype);
         }
         else
@@ -1248,7 +1671,7 @@ namespace OGL
     
     void Renderer::SetFramebuffer(const AbstractFramebuffer* framebuffer)
     {
-        glBindFramebuffer(GL_FRAMEBUFFER, static_cast<const OGLFramebuffer*>(framebuffer)->GetFBO());
+        GLStateTracker::BindFramebuffer(static_cast<const OGLFramebuffer*>(framebuffer)->GetFBO());
         m_current_framebuffer = framebuffer;
         m_current_framebuffer_width = framebuffer->GetWidth();
         m_current_framebuffer_height = framebuffer->GetHeight();
@@ -1267,17 +1690,17 @@ namespace OGL
         
         // NOTE: This disturbs the current scissor/mask setting.
         // This won't be an issue when we implement proper state tracking.
-        glDisable(GL_SCISSOR_TEST);
+        GLStateTracker::SetEnabled(GL_SCISSOR_TEST, false);
         GLbitfield clear_mask = 0;
         if (framebuffer->HasColorBuffer())
         {
-            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            GLStateTracker::SetColorMask(true, true);
             glClearColor(color_value[0], color_value[1], color_value[2], color_value[3]);
             clear_mask |= GL_COLOR_BUFFER_BIT;
         }
         if (framebuffer->HasDepthBuffer())
         {
-            glDepthMask(GL_TRUE);
+            GLStateTracker::SetDepthMask(true);
             glClearDepth(depth_value);
             clear_mask |= GL_DEPTH_BUFFER_BIT;
         }
@@ -1298,7 +1721,7 @@ namespace OGL
         
         if (useShaderBlend)
         {
-            glDisable(GL_BLEND);
+            GLStateTracker::SetEnabled(GL_BLEND, false);
         }
         else
         {
@@ -1321,24 +1744,18 @@ namespace OGL
                 GL_DST_ALPHA,
                 GL_ONE_MINUS_DST_ALPHA};
             
-            if (state.blendenable)
-            {
-                glEnable(GL_BLEND);
-            }
-            else
-            {
-                glDisable(GL_BLEND);
-            }
+            GLStateTracker::SetEnabled(GL_BLEND, state.blendenable);
             
-            // Always call glBlendEquationSeparate and glBlendFuncSeparate, even when
-            // GL_BLEND is disabled, as a workaround for some bugs (possibly graphics
-            // driver issues?). See https://bugs.dolphin-emu.org/issues/10120 : "Sonic
-            // Adventure 2 Battle: graphics crash when loading first Dark level"
+            // Always keep the blend equation and factors up to date, even when GL_BLEND is
+            // disabled, as a workaround for some bugs (possibly graphics driver issues?).
+            // See https://bugs.dolphin-emu.org/issues/10120 : "Sonic Adventure 2 Battle:
+            // graphics crash when loading first Dark level"
             GLenum equation = state.subtract ? GL_FUNC_REVERSE_SUBTRACT : GL_FUNC_ADD;
             GLenum equationAlpha = state.subtractAlpha ? GL_FUNC_REVERSE_SUBTRACT : GL_FUNC_ADD;
-            glBlendEquationSeparate(equation, equationAlpha);
-            glBlendFuncSeparate(src_factors[state.srcfactor], dst_factors[state.dstfactor],
-                                src_factors[state.srcfactoralpha], dst_factors[state.dstfactoralpha]);
+            GLStateTracker::SetBlendEquation(equation, equationAlpha);
+            GLStateTracker::SetBlendFunc(src_factors[state.srcfactor], dst_factors[state.dstfactor],
+                                         src_factors[state.srcfactoralpha],
+                                         dst_factors[state.dstfactoralpha]);
         }
         
         const GLenum logic_op_codes[16] = {
@@ -1352,18 +1769,214 @@ namespace OGL
         }
         else if (state.logicopenable)
         {
-            glEnable(GL_COLOR_LOGIC_OP);
-            glLogicOp(logic_op_codes[state.logicmode]);
+            GLStateTracker::SetEnabled(GL_COLOR_LOGIC_OP, true);
+            GLStateTracker::SetLogicOp(logic_op_codes[state.logicmode]);
         }
         else
         {
-            glDisable(GL_COLOR_LOGIC_OP);
+            GLStateTracker::SetEnabled(GL_COLOR_LOGIC_OP, false);
         }
         
-        glColorMask(state.colorupdate, state.colorupdate, state.colorupdate, state.alphaupdate);
+        GLStateTracker::SetColorMask(state.colorupdate, state.alphaupdate);
         m_current_blend_state = state;
     }
     
+    // Frame dumping. The XFB is read back into a ring of pixel buffer objects, and each one is
+    // mapped once its fence has passed, FRAME_DUMP_READBACK_DEPTH - 1 frames later, so the render
+    // thread never waits on the GPU. Conversion and encoding happen on the FrameDump thread.
+    struct FrameDumpReadback
+    {
+        GLuint buffer = 0;
+        GLsync fence = nullptr;
+        u32 size = 0;
+        int width = 0;
+        int height = 0;
+        u64 ticks = 0;
+    };
+    static const u32 FRAME_DUMP_READBACK_DEPTH = 3;
+    static FrameDumpReadback s_frameDumpReadbacks[FRAME_DUMP_READBACK_DEPTH];
+    static u32 s_frameDumpNextReadback = 0;
+    static bool s_frameDumpActive = false;
+    
+    // Hands finished readbacks to the encoder, oldest first. With wait_all the remaining ones
+    // are waited for, otherwise only the slot about to be reused is.
+    static void RetireFrameDumpReadbacks(bool wait_all)
+    {
+        for (u32 i = 0; i < FRAME_DUMP_READBACK_DEPTH; ++i)
+        {
+            FrameDumpReadback& readback =
+            s_frameDumpReadbacks[(s_frameDumpNextReadback + i) % FRAME_DUMP_READBACK_DEPTH];
+            if (!readback.fence)
+                continue;
+            
+            const bool must_wait = wait_all || i == 0;
+            if (glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                 must_wait ? GL_TIMEOUT_IGNORED : 0) == GL_TIMEOUT_EXPIRED)
+                break;
+            glDeleteSync(readback.fence);
+            readback.fence = nullptr;
+            
+            // Only the first layer is dumped.
+            const int stride = readback.width * sizeof(u32);
+            std::vector<u8> pixels = FrameDump::AcquireBuffer(stride * readback.height);
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+            const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, pixels.size(), GL_MAP_READ_BIT);
+            if (mapped)
+            {
+                memcpy(pixels.data(), mapped, pixels.size());
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+                FrameDump::SubmitFrame(std::move(pixels), readback.width, readback.height, stride,
+                                       readback.ticks);
+            }
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    
+    static void QueueFrameDumpReadback(OGLTexture* xfb_texture, u64 ticks)
+    {
+        GPUTimer::ScopedPass timer(GPUTimer::Pass::FrameDump);
+        RetireFrameDumpReadbacks(false);
+        s_frameDumpActive = true;
+        
+        const TextureConfig& config = xfb_texture->GetConfig();
+        FrameDumpReadback& readback = s_frameDumpReadbacks[s_frameDumpNextReadback];
+        s_frameDumpNextReadback = (s_frameDumpNextReadback + 1) % FRAME_DUMP_READBACK_DEPTH;
+        
+        const u32 size = config.width * config.height * config.layers * sizeof(u32);
+        if (!readback.buffer)
+            glGenBuffers(1, &readback.buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+        if (readback.size != size)
+        {
+            glBufferData(GL_PIXEL_PACK_BUFFER, size, nullptr, GL_STREAM_READ);
+            readback.size = size;
+        }
+        readback.width = config.width;
+        readback.height = config.height;
+        readback.ticks = ticks;
+        
+        GLint active_texture;
+        glGetIntegerv(GL_ACTIVE_TEXTURE, &active_texture);
+        glActiveTexture(GL_TEXTURE9);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, xfb_texture->GetRawTexIdentifier());
+        glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glActiveTexture(active_texture);
+        readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    
+    // Drains the readbacks still in flight and finishes the dump.
+    static void StopFrameDump()
+    {
+        RetireFrameDumpReadbacks(true);
+        FrameDump::Stop();
+        s_frameDumpActive = false;
+    }
+    
+    static void DestroyFrameDumpReadbacks()
+    {
+        StopFrameDump();
+        for (FrameDumpReadback& readback : s_frameDumpReadbacks)
+        {
+            if (readback.buffer)
+                glDeleteBuffers(1, &readback.buffer);
+            readback = FrameDumpReadback();
+        }
+        s_frameDumpNextReadback = 0;
+    }
+    
+    // Present statistics, reported every EFB_PEEK_STATS_INTERVAL frames.
+    static u64 s_presentPixels = 0;
+    static u64 s_presentClearedPixels = 0;
+    static u32 s_presentFrames = 0;
+    
+    // Clears the parts of the presentation framebuffer that the blit to dst won't cover. Nothing
+    // is drawn with depth there, so the depth buffer is left alone.
+    static void ClearPresentationBorders(int width, int height, const TargetRectangle& dst)
+    {
+        // BlitScreen sets the viewport from the left and bottom edges of the flipped rectangle.
+        const int x0 = MathUtil::Clamp(dst.left, 0, width);
+        const int x1 = MathUtil::Clamp(dst.left + dst.GetWidth(), 0, width);
+        const int y0 = MathUtil::Clamp(dst.bottom, 0, height);
+        const int y1 = MathUtil::Clamp(dst.bottom + dst.GetHeight(), 0, height);
+        const u64 pixels = static_cast<u64>(width) * height;
+        
+        glClearColor(0, 0, 0, 0);
+        u64 cleared = 0;
+        if (x0 >= x1 || y0 >= y1 || g_ActiveConfig.stereo_mode != StereoMode::Off)
+        {
+            glClear(GL_COLOR_BUFFER_BIT);
+            cleared = pixels;
+        }
+        else
+        {
+            const int borders[4][4] = {
+                {0, 0, width, y0},              // bottom
+                {0, y1, width, height - y1},    // top
+                {0, y0, x0, y1 - y0},           // left
+                {x1, y0, width - x1, y1 - y0},  // right
+            };
+            glEnable(GL_SCISSOR_TEST);
+            for (const auto& border : borders)
+            {
+                if (border[2] <= 0 || border[3] <= 0)
+                    continue;
+                glScissor(border[0], border[1], border[2], border[3]);
+                glClear(GL_COLOR_BUFFER_BIT);
+                cleared += static_cast<u64>(border[2]) * border[3];
+            }
+            glDisable(GL_SCISSOR_TEST);
+        }
+        
+        s_presentPixels += pixels;
+        s_presentClearedPixels += cleared;
+        s_presentFrames++;
+    }
+    
+    // Present pacing. Every submitted frame gets a fence, and once more than iPresentQueueDepth
+    // frames are queued the CPU waits for the oldest, so it runs a fixed number of frames ahead.
+    static const int MAX_PRESENT_QUEUE_DEPTH = 3;
+    static std::deque<GLsync> s_presentFences;
+    static u32 s_presentQueueFrames = 0;
+    static u32 s_presentQueueInFlight = 0;
+    static u64 s_presentQueueWaitUs = 0;
+    static u64 s_presentQueueMaxWaitUs = 0;
+    
+    static void PacePresentQueue()
+    {
+        const size_t depth = static_cast<size_t>(
+        MathUtil::Clamp(g_ActiveConfig.iPresentQueueDepth, 1, MAX_PRESENT_QUEUE_DEPTH));
+        
+        // How many earlier frames the GPU is still working on.
+        for (GLsync fence : s_presentFences)
+        {
+            if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+                s_presentQueueInFlight++;
+        }
+        
+        s_presentFences.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+        glFlush();
+        
+        const u64 start_time = Common::Timer::GetTimeUs();
+        while (s_presentFences.size() > depth)
+        {
+            glClientWaitSync(s_presentFences.front(), GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(s_presentFences.front());
+            s_presentFences.pop_front();
+        }
+        const u64 wait_us = Common::Timer::GetTimeUs() - start_time;
+        s_presentQueueWaitUs += wait_us;
+        s_presentQueueMaxWaitUs = std::max(s_presentQueueMaxWaitUs, wait_us);
+        s_presentQueueFrames++;
+    }
+    
+    static void DestroyPresentQueue()
+    {
+        for (GLsync fence : s_presentFences)
+            glDeleteSync(fence);
+        s_presentFences.clear();
+    }
+    
     // This function has the final picture. We adjust the aspect ratio here.
     void Renderer::SwapImpl(AbstractTexture* texture, const EFBRectangle& xfb_region, u64 ticks)
     {
@@ -1381,8 +1994,64 @@ namespace OGL
         sourceRc.top = xfb_region.GetHeight();
         sourceRc.bottom = 0;
         
+        // Only the present passes below are timed, not the wait for the present queue.
+        ScopedResetPass timer(GPUTimer::Pass::Count);
         ResetAPIState();
         
+        if (s_efbPeekCount && frameCount % EFB_PEEK_STATS_INTERVAL == 0)
+        {
+            INFO_LOG(VIDEO, "EFB peeks: %u, %.1f%% served from prefetch, %u readbacks, %.2f ms stalled, "
+                     "%.0f ns per tile conversion at %dx%d",
+                     s_efbPeekCount, 100.0 * s_efbPeekPrefetchHits / s_efbPeekCount,
+                     s_efbPeekReadbacks, s_efbPeekStallUs / 1000.0,
+                     s_efbTileConversions ? static_cast<double>(s_efbTileConversionNs) / s_efbTileConversions : 0.0,
+                     m_target_width, m_target_height);
+            s_efbPeekCount = 0;
+            s_efbPeekPrefetchHits = 0;
+            s_efbPeekReadbacks = 0;
+            s_efbPeekStallUs = 0;
+            s_efbTileConversions = 0;
+            s_efbTileConversionNs = 0;
+        }
+        
+        if (s_presentFrames && frameCount % EFB_PEEK_STATS_INTERVAL == 0)
+        {
+            // Before, the whole colour buffer and a 32-bit depth buffer were cleared every frame.
+            const u64 saved_bytes = (2 * s_presentPixels - s_presentClearedPixels) * sizeof(u32);
+            INFO_LOG(VIDEO, "Present: %dx%d output, %.1f%% cleared as borders, %.2f MB/frame of "
+                     "clears skipped",
+                     m_backbuffer_width, m_backbuffer_height,
+                     100.0 * s_presentClearedPixels / s_presentPixels,
+                     saved_bytes / (1024.0 * 1024.0) / s_presentFrames);
+            s_presentPixels = 0;
+            s_presentClearedPixels = 0;
+            s_presentFrames = 0;
+        }
+        
+        if (s_presentQueueFrames && frameCount % EFB_PEEK_STATS_INTERVAL == 0)
+        {
+            INFO_LOG(VIDEO, "Present queue: depth %d, %.2f frames in flight on average, "
+                     "%.3f ms/frame waited (max %.3f ms)",
+                     g_ActiveConfig.iPresentQueueDepth,
+                     static_cast<float>(s_presentQueueInFlight) / s_presentQueueFrames,
+                     s_presentQueueWaitUs / 1000.0 / s_presentQueueFrames,
+                     s_presentQueueMaxWaitUs / 1000.0);
+            s_presentQueueFrames = 0;
+            s_presentQueueInFlight = 0;
+            s_presentQueueWaitUs = 0;
+            s_presentQueueMaxWaitUs = 0;
+        }
+        
+        if (s_bboxReads && frameCount % EFB_PEEK_STATS_INTERVAL == 0)
+        {
+            INFO_LOG(VIDEO, "Bounding box: %u reads, %.2f readbacks/frame, %.3f ms stalled/frame",
+                     s_bboxReads, static_cast<float>(s_bboxReadbacks) / EFB_PEEK_STATS_INTERVAL,
+                     s_bboxStallUs / 1000.0 / EFB_PEEK_STATS_INTERVAL);
+            s_bboxReads = 0;
+            s_bboxReadbacks = 0;
+            s_bboxStallUs = 0;
+        }
+        
         // Do our OSD callbacks
         OSD::DoCallbacks(OSD::CallbackType::OnFrame);
         
@@ -1393,37 +2062,60 @@ namespace OGL
         TargetRectangle flipped_trc = GetTargetRectangle();
         std::swap(flipped_trc.top, flipped_trc.bottom);
         
-        // Skip screen rendering when running in headless mode.
-        if (IsHeadless())
+        // Hash the output every so often, so it can be verified even when it isn't presented.
+        if (FrameHash::IsDue(frameCount))
+        {
+            const TextureConfig& config = xfb_texture->GetConfig();
+            std::vector<u8> pixels(config.width * config.height * config.layers * sizeof(u32));
+            // SetTexture doesn't track the active unit, so put back whatever GL has now.
+            GLint active_texture;
+            glGetIntegerv(GL_ACTIVE_TEXTURE, &active_texture);
+            glActiveTexture(GL_TEXTURE9);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, xfb_texture->GetRawTexIdentifier());
+            glGetTexImage(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+            glActiveTexture(active_texture);
+            FrameHash::Submit(frameCount, pixels.data(), static_cast<u32>(pixels.size()));
+        }
+        
+        if (FrameDump::IsEnabled())
+            QueueFrameDumpReadback(xfb_texture, ticks);
+        else if (s_frameDumpActive)
+            StopFrameDump();
+        
+        // Skip screen rendering when running in headless mode. Benchmarks skip presentation
+        // entirely, the bookkeeping below still runs.
+        if (!g_ActiveConfig.bNoPresent && IsHeadless())
         {
-            // Clear the framebuffer before drawing anything.
+            // Draw straight into the host's framebuffer. The post-processing shader, scaling and
+            // aspect correction all happen in the one blit, so only the borders need clearing.
             glBindFramebuffer(GL_FRAMEBUFFER,  g_Config.iRenderFBO);
-            glClearColor(0, 0, 0, 0);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            ClearPresentationBorders(m_backbuffer_width, m_backbuffer_height, flipped_trc);
             m_current_framebuffer = nullptr;
             m_current_framebuffer_width = m_backbuffer_width;
             m_current_framebuffer_height = m_backbuffer_height;
             
             // Copy the framebuffer to screen.
+            GPUTimer::Begin(GPUTimer::Pass::Present);
             BlitScreen(sourceRc, flipped_trc, xfb_texture->GetRawTexIdentifier(),
                        xfb_texture->GetConfig().width, xfb_texture->GetConfig().height);
+            GPUTimer::End(GPUTimer::Pass::Present);
             
             // Render OSD messages.
+            GPUTimer::Begin(GPUTimer::Pass::OSD);
             glViewport(0, 0, m_backbuffer_width, m_backbuffer_height);
             glEnable(GL_BLEND);
             glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
             DrawDebugText();
             OSD::DrawMessages();
+            GPUTimer::End(GPUTimer::Pass::OSD);
             
             // Swap the back and front buffers, presenting the image.
             GLInterface->Swap();
         }
-        else
-        {
-            // Since we're not swapping in headless mode, ensure all commands are sent to the GPU.
-            // Otherwise the driver could batch several frames togehter.
-            glFlush();
-        }
+        
+        // Submit the frame and bound how many are queued on the GPU. When not swapping this also
+        // keeps the driver from batching several frames together.
+        PacePresentQueue();
         
         // Was the size changed since the last frame?
         bool target_size_changed = CalculateTargetSize();
@@ -1450,6 +2142,10 @@ namespace OGL
                                 10000);
             }
             
+            // Prefetched tiles and bounding box values were read at the old size.
+            DiscardEFBPrefetch();
+            s_bboxCacheValid = false;
+            
             g_framebuffer_manager.reset();
             g_framebuffer_manager = std::make_unique<FramebufferManager>(
                                                                          m_target_width, m_target_height, s_MSAASamples, BoundingBox::NeedsStencilBuffer());
@@ -1465,21 +2161,45 @@ namespace OGL
         }
         
         // Clean out old stuff from caches. It's not worth it to clean out the shader caches.
-        g_texture_cache->Cleanup(frameCount);
+        // OE: over the texture budget entries are aged faster, see TextureMemory.h.
+        g_texture_cache->Cleanup(TextureMemory::GetCleanupFrame(frameCount));
         
         RestoreAPIState();
+        GPUTimer::EndFrame(frameCount);
+        GLStateTracker::EndFrame(frameCount);
+        PerfQueryPool::EndFrame(frameCount);
+        TextureUpload::EndFrame(frameCount);
+        TextureMemory::EndFrame(frameCount);
+        
+        // Pick the shader compilation mode for the next frame.
+        AdaptiveShaderCompilation::Update();
+        // Pick the internal resolution. A new scale recreates the framebuffers at the next swap,
+        // which also drops the EFB peek cache, the prefetched tiles and the bounding box values.
+        DynamicResolution::Update();
+        
+        if (g_Config.iSaveTargetId != 0)
+        {
+            g_Config.iSaveTargetId = 0;
+            g_Config.MarkChanged();
+        }
         
-        g_Config.iSaveTargetId = 0;
-        
-        int old_anisotropy = g_ActiveConfig.iMaxAnisotropy;
-        UpdateActiveConfig();
-        g_texture_cache->OnConfigChanged(g_ActiveConfig);
-        
-        if (old_anisotropy != g_ActiveConfig.iMaxAnisotropy)
-            g_sampler_cache->Clear();
-        
-        // Invalidate shader cache when the host config changes.
-        CheckForHostConfigChanges();
+        // Only copy the config and re-evaluate the caches when a writer bumped the generation.
+        if (g_Config.iGeneration != g_ActiveConfig.iGeneration)
+        {
+            s_configReconfigurations++;
+            
+            int old_anisotropy = g_ActiveConfig.iMaxAnisotropy;
+            UpdateActiveConfig();
+            g_texture_cache->OnConfigChanged(g_ActiveConfig);
+            
+            if (old_anisotropy != g_ActiveConfig.iMaxAnisotropy)
+                g_sampler_cache->Clear();
+            
+            // Invalidate shader cache when the host config changes.
+            CheckForHostConfigChanges();
+            
+            TextureHash::SetVerify(g_ActiveConfig.bVerifyTextureHashes);
+        }
         
         // For testing zbuffer targets.
         // Renderer::SetZBufferRender();
@@ -1527,36 +2247,51 @@ namespace OGL
     // ALWAYS call RestoreAPIState for each ResetAPIState call you're doing
     void Renderer::ResetAPIState()
     {
+        // Anything done with the state reset may touch the EFB, so draw the queued pokes first.
+        FlushEFBPokes();
+        GPUTimer::End(GPUTimer::Pass::EFBDraw);
+        s_openResetPass = s_resetPass;
+        if (s_openResetPass != GPUTimer::Pass::Count)
+            GPUTimer::Begin(s_openResetPass);
+        
         // Gets us to a reasonably sane state where it's possible to do things like
         // image copies with textured quads, etc.
-        glDisable(GL_SCISSOR_TEST);
-        glDisable(GL_DEPTH_TEST);
-        glDisable(GL_CULL_FACE);
-        glDisable(GL_BLEND);
+        GLStateTracker::SetEnabled(GL_SCISSOR_TEST, false);
+        GLStateTracker::SetEnabled(GL_DEPTH_TEST, false);
+        GLStateTracker::SetEnabled(GL_CULL_FACE, false);
+        GLStateTracker::SetEnabled(GL_BLEND, false);
         if (GLInterface->GetMode() == GLInterfaceMode::MODE_OPENGL)
-            glDisable(GL_COLOR_LOGIC_OP);
+            GLStateTracker::SetEnabled(GL_COLOR_LOGIC_OP, false);
         if (g_ActiveConfig.backend_info.bSupportsDepthClamp)
         {
-            glDisable(GL_CLIP_DISTANCE0);
-            glDisable(GL_CLIP_DISTANCE1);
+            GLStateTracker::SetEnabled(GL_CLIP_DISTANCE0, false);
+            GLStateTracker::SetEnabled(GL_CLIP_DISTANCE1, false);
         }
-        glDepthMask(GL_FALSE);
-        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        GLStateTracker::SetDepthMask(false);
+        GLStateTracker::SetColorMask(true, true);
+        
+        // Whoever reset the state sets GL state directly until RestoreAPIState.
+        GLStateTracker::Invalidate();
     }
     
     void Renderer::RestoreAPIState()
     {
+        if (s_openResetPass != GPUTimer::Pass::Count)
+            GPUTimer::End(s_openResetPass);
+        s_openResetPass = GPUTimer::Pass::Count;
+        GPUTimer::Begin(GPUTimer::Pass::EFBDraw);
+        
         m_current_framebuffer = nullptr;
         m_current_framebuffer_width = m_target_width;
         m_current_framebuffer_height = m_target_height;
         FramebufferManager::SetFramebuffer(0);
         
         // Gets us back into a more game-like state.
-        glEnable(GL_SCISSOR_TEST);
+        GLStateTracker::SetEnabled(GL_SCISSOR_TEST, true);
         if (g_ActiveConfig.backend_info.bSupportsDepthClamp)
         {
-            glEnable(GL_CLIP_DISTANCE0);
-            glEnable(GL_CLIP_DISTANCE1);
+            GLStateTracker::SetEnabled(GL_CLIP_DISTANCE0, true);
+            GLStateTracker::SetEnabled(GL_CLIP_DISTANCE1, true);
         }
         BPFunctions::SetScissor();
         BPFunctions::SetViewport();
@@ -1575,12 +2310,12 @@ namespace OGL
         if (state.cullmode != GenMode::CULL_NONE)
         {
             // TODO: GX_CULL_ALL not supported, yet!
-            glEnable(GL_CULL_FACE);
-            glFrontFace(state.cullmode == GenMode::CULL_FRONT ? GL_CCW : GL_CW);
+            GLStateTracker::SetEnabled(GL_CULL_FACE, true);
+            GLStateTracker::SetFrontFace(state.cullmode == GenMode::CULL_FRONT ? GL_CCW : GL_CW);
         }
         else
         {
-            glDisable(GL_CULL_FACE);
+            GLStateTracker::SetEnabled(GL_CULL_FACE, false);
         }
         
         m_current_rasterization_state = state;
@@ -1596,17 +2331,17 @@ namespace OGL
         
         if (state.testenable)
         {
-            glEnable(GL_DEPTH_TEST);
-            glDepthMask(state.updateenable ? GL_TRUE : GL_FALSE);
-            glDepthFunc(glCmpFuncs[state.func]);
+            GLStateTracker::SetEnabled(GL_DEPTH_TEST, true);
+            GLStateTracker::SetDepthMask(state.updateenable);
+            GLStateTracker::SetDepthFunc(glCmpFuncs[state.func]);
         }
         else
         {
             // if the test is disabled write is disabled too
             // TODO: When PE performance metrics are being emulated via occlusion queries, we should
             // (probably?) enable depth test with depth function ALWAYS here
-            glDisable(GL_DEPTH_TEST);
-            glDepthMask(GL_FALSE);
+            GLStateTracker::SetEnabled(GL_DEPTH_TEST, false);
+            GLStateTracker::SetDepthMask(false);
         }
         
         m_current_depth_state = state;
@@ -1620,6 +2355,18 @@ namespace OGL
         if (!m_graphics_pipeline)
             return;
         
+        // Pokes have to land before the draw that uses this pipeline.
+        FlushEFBPokes();
+        
+        // A draw with bounding box enabled may grow it.
+        if (::BoundingBox::active)
+            s_bboxCacheValid = false;
+        
+        // Timed in chunks, so the GPU timer doesn't miss the work done while a long run of draws
+        // was still being submitted.
+        if (++s_timedDraws % DRAW_TIMER_CHUNK == 0)
+            GPUTimer::Split(GPUTimer::Pass::EFBDraw);
+        
         ApplyRasterizationState(m_graphics_pipeline->GetRasterizationState());
         ApplyDepthState(m_graphics_pipeline->GetDepthState());
         ApplyBlendingState(m_graphics_pipeline->GetBlendingState());
@@ -1630,8 +2377,12 @@ namespace OGL
     void Renderer::SetTexture(u32 index, const AbstractTexture* texture)
     {
         if (m_bound_textures[index] == texture)
+        {
+            GLStateTracker::CountSkipped();
             return;
+        }
         
+        GLStateTracker::CountIssued();
         glActiveTexture(GL_TEXTURE0 + index);
         glBindTexture(GL_TEXTURE_2D_ARRAY,
                       texture ? static_cast<const OGLTexture*>(texture)->GetRawTexIdentifier() : 0);
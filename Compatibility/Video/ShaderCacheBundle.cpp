@@ -0,0 +1,179 @@
+// Copyright 2018 Dolphin Emulator Project
+// Licensed under GPLv2+
+// Refer to the license.txt file included.
+
+#include "ShaderCacheBundle.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "Common/CommonPaths.h"
+#include "Common/CommonTypes.h"
+#include "Common/File.h"
+#include "Common/FileUtil.h"
+#include "Common/Logging/Log.h"
+#include "Common/StringUtil.h"
+#include "Common/Version.h"
+
+#include "Core/ConfigManager.h"
+
+#include "VideoBackends/OGL/Render.h"
+
+#include "VideoCommon/VideoConfig.h"
+
+namespace ShaderCacheBundle
+{
+static constexpr u32 BUNDLE_VERSION = 2;
+static const char MANIFEST_NAME[] = "manifest.txt";
+static const char STAMP_NAME[] = "bundle.stamp";
+
+// Mirrors LinearDiskCache's file header: a "DCAC" tag, the u16 sizes of its key and value
+// types, then the build's git revision.
+static constexpr size_t CACHE_ID_SIZE = 4;
+static constexpr size_t CACHE_TYPE_SIZES_SIZE = 4;
+static constexpr size_t CACHE_VERSION_OFFSET = CACHE_ID_SIZE + CACHE_TYPE_SIZES_SIZE;
+static constexpr size_t CACHE_VERSION_SIZE = 40;
+static constexpr size_t CACHE_HEADER_SIZE = CACHE_VERSION_OFFSET + CACHE_VERSION_SIZE;
+
+static std::string GetManifest()
+{
+  return StringFromFormat("version=%u\nbuild=%s\nvendor=%s\nrenderer=%s\ngl_version=%s\n",
+                          BUNDLE_VERSION, scm_rev_git_str.c_str(), OGL::g_ogl_config.gl_vendor,
+                          OGL::g_ogl_config.gl_renderer, OGL::g_ogl_config.gl_version);
+}
+
+// The running game's files in the shader cache directory, which carry its ID in their name.
+static std::vector<File::FSTEntry> GetGameCacheFiles(const std::string& directory)
+{
+  std::vector<File::FSTEntry> files;
+  const std::string& game_id = SConfig::GetInstance().GetGameID();
+  if (game_id.empty() || !File::IsDirectory(directory))
+    return files;
+
+  const std::string tag = "-" + game_id + "-";
+  for (const File::FSTEntry& entry : File::ScanDirectoryTree(directory, false).children)
+  {
+    if (!entry.isDirectory && StringEndsWith(entry.virtualName, ".cache") &&
+        entry.virtualName.find(tag) != std::string::npos)
+    {
+      files.push_back(entry);
+    }
+  }
+  return files;
+}
+
+// Whether LinearDiskCache would keep the file's entries when opening it in this build.
+static bool HasCurrentHeader(const std::string& path, std::string* version)
+{
+  char header[CACHE_HEADER_SIZE] = {};
+  File::IOFile file(path, "rb");
+  if (!file.ReadBytes(header, sizeof(header)) || std::memcmp(header, "DCAC", CACHE_ID_SIZE) != 0)
+  {
+    *version = "not a cache file";
+    return false;
+  }
+
+  char expected[CACHE_VERSION_SIZE] = {};
+  std::memcpy(expected, scm_rev_git_str.c_str(),
+              std::min(scm_rev_git_str.size(), sizeof(expected)));
+  *version = std::string(header + CACHE_VERSION_OFFSET,
+                         strnlen(header + CACHE_VERSION_OFFSET, CACHE_VERSION_SIZE));
+  return std::memcmp(header + CACHE_VERSION_OFFSET, expected, CACHE_VERSION_SIZE) == 0;
+}
+
+// A local file with entries from this build is kept, the bundle's copy would only replace it.
+static bool HasUsableLocalCopy(const std::string& path)
+{
+  std::string version;
+  return File::GetSize(path) > CACHE_HEADER_SIZE &&
+         HasCurrentHeader(path, &version);
+}
+
+void Import(const std::string& bundle_path)
+{
+  if (bundle_path.empty() || !g_ActiveConfig.bShaderCache)
+    return;
+
+  std::string manifest;
+  u32 version = 0;
+  if (!File::ReadFileToString(bundle_path + DIR_SEP + MANIFEST_NAME, manifest) ||
+      std::sscanf(manifest.c_str(), "version=%u", &version) != 1 || version != BUNDLE_VERSION)
+  {
+    WARN_LOG(VIDEO, "Shader cache bundle %s rejected: missing or unsupported manifest",
+             bundle_path.c_str());
+    return;
+  }
+
+  const std::string cache_path = File::GetUserPath(D_SHADERCACHE_IDX);
+  const std::string stamp_path = cache_path + SConfig::GetInstance().GetGameID() + "-" + STAMP_NAME;
+  std::string imported_manifest;
+  if (File::ReadFileToString(stamp_path, imported_manifest) && imported_manifest == manifest)
+    return;
+
+  u32 copied = 0;
+  u32 kept = 0;
+  u32 rejected = 0;
+  for (const File::FSTEntry& entry : GetGameCacheFiles(bundle_path))
+  {
+    std::string file_version;
+    if (!HasCurrentHeader(entry.physicalName, &file_version))
+    {
+      WARN_LOG(VIDEO, "Shader cache bundle: %s rejected, written by %s rather than %s",
+               entry.virtualName.c_str(), file_version.c_str(), scm_rev_git_str.c_str());
+      rejected++;
+      continue;
+    }
+
+    const std::string local_path = cache_path + entry.virtualName;
+    if (HasUsableLocalCopy(local_path))
+    {
+      kept++;
+      continue;
+    }
+
+    if (File::CreateFullPath(local_path) && File::Copy(entry.physicalName, local_path))
+      copied++;
+    else
+      rejected++;
+  }
+
+  if (rejected)
+  {
+    WARN_LOG(VIDEO, "Shader cache bundle %s: %u files imported, %u kept, %u rejected, not "
+                    "marking it as imported",
+             bundle_path.c_str(), copied, kept, rejected);
+    return;
+  }
+
+  File::WriteStringToFile(manifest, stamp_path);
+  NOTICE_LOG(VIDEO, "Shader cache bundle %s: %u files imported, %u already in the local cache",
+             bundle_path.c_str(), copied, kept);
+}
+
+void Export(const std::string& bundle_path)
+{
+  if (bundle_path.empty() || !g_ActiveConfig.bShaderCache)
+    return;
+
+  const std::vector<File::FSTEntry> files = GetGameCacheFiles(File::GetUserPath(D_SHADERCACHE_IDX));
+  if (files.empty())
+    return;
+
+  if (!File::CreateFullPath(bundle_path + DIR_SEP))
+  {
+    ERROR_LOG(VIDEO, "Failed to create shader cache bundle directory %s", bundle_path.c_str());
+    return;
+  }
+
+  u32 exported = 0;
+  for (const File::FSTEntry& entry : files)
+  {
+    if (File::Copy(entry.physicalName, bundle_path + DIR_SEP + entry.virtualName))
+      exported++;
+  }
+  File::WriteStringToFile(GetManifest(), bundle_path + DIR_SEP + MANIFEST_NAME);
+  NOTICE_LOG(VIDEO, "Exported %u shader cache files to %s", exported, bundle_path.c_str());
+}
+}
@@ -0,0 +1,26 @@
+// Copyright 2018 Dolphin Emulator Project
+// Licensed under GPLv2+
+// Refer to the license.txt file included.
+
+// Shader cache bundles: a directory holding copies of the running game's files from the shader
+// cache directory, plus a manifest naming the build and driver that wrote them. Installing one
+// next to the core gives a fresh install a warm cache. Bundles are built by running the games
+// with the export directory present, each session adds its game's files to it.
+//
+// Files are taken whole. A bundle file is only copied in when the local cache has no usable copy
+// of it, and only if its LinearDiskCache header matches this build; LinearDiskCache would
+// otherwise discard it on open. A bundle is stamped as imported only once all of its files
+// passed, so a rejected one is reported again on the next boot rather than silently dropped.
+
+#pragma once
+
+#include <string>
+
+namespace ShaderCacheBundle
+{
+// Called when the renderer is created, before the shader cache files are opened.
+void Import(const std::string& bundle_path);
+
+// Called when the renderer is destroyed, after the shader cache files have been closed.
+void Export(const std::string& bundle_path);
+}
@@ -0,0 +1,198 @@
+// Copyright 2018 Dolphin Emulator Project
+// Licensed under GPLv2+
+// Refer to the license.txt file included.
+
+#include "TextureMemory.h"
+
+#include <algorithm>
+#include <array>
+#include <string>
+
+#include "Common/Logging/Log.h"
+#include "Common/StringUtil.h"
+
+#include "VideoCommon/AbstractTexture.h"
+#include "VideoCommon/VideoConfig.h"
+
+namespace TextureMemory
+{
+static constexpr u64 STATS_INTERVAL = 600;
+// Upstream TEXTURE_KILL_THRESHOLD. Capping the offset below it spares what the last few frames
+// used, dropping those would only have them decoded or copied again.
+static constexpr int KILL_THRESHOLD = 64;
+static constexpr int MAX_AGE_OFFSET = KILL_THRESHOLD - 4;
+// Frames of age added per frame while over budget.
+static constexpr int AGE_STEP = 4;
+// Pressure is only released below this fraction of the budget.
+static constexpr float RELEASE_FRACTION = 0.9f;
+// Still over budget after this many frames at the largest offset, the budget is out of reach:
+// what's left is in use, and more pressure would only have it decoded or copied every frame.
+// Pressure is then suspended until usage grows by a quarter or the cooldown has passed.
+static constexpr u32 UNREACHABLE_FRAMES = 60;
+static constexpr u32 SUSPEND_FRAMES = 1800;
+static constexpr float RESUME_GROWTH = 1.25f;
+
+enum Origin : u32
+{
+  ORIGIN_LOADED,
+  ORIGIN_EFB_COPY,
+  ORIGIN_COUNT
+};
+
+static constexpr u32 FORMAT_COUNT = static_cast<u32>(AbstractTextureFormat::Undefined) + 1;
+
+struct Usage
+{
+  u64 bytes = 0;
+  u32 textures = 0;
+};
+
+static std::array<std::array<Usage, ORIGIN_COUNT>, FORMAT_COUNT> s_usage;
+static u64 s_total_bytes = 0;
+static u64 s_peak_bytes = 0;
+static int s_age_offset = 0;
+static u32 s_pressure_frames = 0;
+static u32 s_saturated_frames = 0;
+static u32 s_suspended_frames = 0;
+static u64 s_suspended_bytes = 0;
+static bool s_warned_unreachable = false;
+
+static const char* GetFormatName(AbstractTextureFormat format)
+{
+  switch (format)
+  {
+  case AbstractTextureFormat::RGBA8:
+    return "RGBA8";
+  case AbstractTextureFormat::BGRA8:
+    return "BGRA8";
+  case AbstractTextureFormat::DXT1:
+    return "DXT1";
+  case AbstractTextureFormat::DXT3:
+    return "DXT3";
+  case AbstractTextureFormat::DXT5:
+    return "DXT5";
+  default:
+    return "other";
+  }
+}
+
+static u64 GetSize(const TextureConfig& config)
+{
+  const bool compressed = AbstractTexture::IsCompressedFormat(config.format);
+  u64 size = 0;
+  for (u32 level = 0; level < config.levels; ++level)
+  {
+    const u32 width = std::max(config.width >> level, 1u);
+    const u32 height = std::max(config.height >> level, 1u);
+    // Compressed strides cover a row of 4x4 blocks, partial blocks included.
+    const u32 rows = compressed ? (height + 3) / 4 : height;
+    const u32 stride_width = compressed ? (width + 3) & ~3u : width;
+    size += AbstractTexture::CalculateStrideForFormat(config.format, stride_width) * rows;
+  }
+  return size * config.layers;
+}
+
+static Usage& GetUsage(const TextureConfig& config)
+{
+  const u32 format = std::min(static_cast<u32>(config.format), FORMAT_COUNT - 1);
+  return s_usage[format][config.rendertarget ? ORIGIN_EFB_COPY : ORIGIN_LOADED];
+}
+
+void Add(const TextureConfig& config)
+{
+  const u64 size = GetSize(config);
+  Usage& usage = GetUsage(config);
+  usage.bytes += size;
+  usage.textures++;
+  s_total_bytes += size;
+  s_peak_bytes = std::max(s_peak_bytes, s_total_bytes);
+}
+
+void Remove(const TextureConfig& config)
+{
+  const u64 size = GetSize(config);
+  Usage& usage = GetUsage(config);
+  usage.bytes -= size;
+  usage.textures--;
+  s_total_bytes -= size;
+}
+
+int GetCleanupFrame(int frame_count)
+{
+  const u64 budget = static_cast<u64>(std::max(g_ActiveConfig.iTextureCacheBudgetMB, 0)) << 20;
+  if (s_suspended_frames)
+  {
+    s_suspended_frames--;
+    if (s_total_bytes > s_suspended_bytes * RESUME_GROWTH)
+      s_suspended_frames = 0;
+  }
+
+  if (budget && s_total_bytes > budget && !s_suspended_frames)
+  {
+    s_age_offset = std::min(s_age_offset + AGE_STEP, MAX_AGE_OFFSET);
+    s_pressure_frames++;
+    s_saturated_frames = s_age_offset == MAX_AGE_OFFSET ? s_saturated_frames + 1 : 0;
+    if (s_saturated_frames >= UNREACHABLE_FRAMES)
+    {
+      if (!s_warned_unreachable)
+      {
+        WARN_LOG(VIDEO, "Texture memory: %.1f MiB still in use after evicting all but the last "
+                        "%d frames' textures, the %d MiB budget is out of reach; easing off",
+                 s_total_bytes / 1048576.0, KILL_THRESHOLD - MAX_AGE_OFFSET,
+                 g_ActiveConfig.iTextureCacheBudgetMB);
+        s_warned_unreachable = true;
+      }
+      s_saturated_frames = 0;
+      s_suspended_frames = SUSPEND_FRAMES;
+      s_suspended_bytes = s_total_bytes;
+    }
+  }
+  else if (s_age_offset &&
+           (!budget || s_suspended_frames || s_total_bytes < budget * RELEASE_FRACTION))
+  {
+    s_saturated_frames = 0;
+    s_age_offset--;
+  }
+  return frame_count + s_age_offset;
+}
+
+void EndFrame(u64 frame_number)
+{
+  if (frame_number % STATS_INTERVAL != 0 || !s_peak_bytes)
+    return;
+
+  std::string formats;
+  for (u32 format = 0; format < FORMAT_COUNT; ++format)
+  {
+    for (u32 origin = 0; origin < ORIGIN_COUNT; ++origin)
+    {
+      const Usage& usage = s_usage[format][origin];
+      if (!usage.textures)
+        continue;
+      formats += StringFromFormat(" %s%s %.1f (%u)",
+                                  GetFormatName(static_cast<AbstractTextureFormat>(format)),
+                                  origin == ORIGIN_EFB_COPY ? " EFB copy" : "",
+                                  usage.bytes / 1048576.0, usage.textures);
+    }
+  }
+  INFO_LOG(VIDEO, "Texture memory (MiB): %.1f, peak %.1f, budget %d, over budget %u frames, "
+                  "age offset %d%s |%s",
+           s_total_bytes / 1048576.0, s_peak_bytes / 1048576.0,
+           g_ActiveConfig.iTextureCacheBudgetMB, s_pressure_frames, s_age_offset,
+           s_suspended_frames ? ", pressure suspended" : "", formats.c_str());
+  s_peak_bytes = s_total_bytes;
+  s_pressure_frames = 0;
+}
+
+// Textures still alive are removed later by their destructors, so only the budget state is reset.
+void Shutdown()
+{
+  s_age_offset = 0;
+  s_pressure_frames = 0;
+  s_saturated_frames = 0;
+  s_suspended_frames = 0;
+  s_suspended_bytes = 0;
+  s_warned_unreachable = false;
+  s_peak_bytes = s_total_bytes;
+}
+}
@@ -0,0 +1,33 @@
+// Copyright 2018 Dolphin Emulator Project
+// Licensed under GPLv2+
+// Refer to the license.txt file included.
+
+// Texture memory accounting and a budget for the texture cache. Every texture the renderer
+// creates is counted by format and origin (loaded from RAM or an EFB copy target), pooled
+// textures included.
+//
+// The cache evicts by age only, entries unused for TEXTURE_KILL_THRESHOLD frames. Over budget
+// the frame count handed to its Cleanup is advanced a few frames at a time, so the least
+// recently used entries go first and the eviction is spread over several frames instead of
+// happening at once. Under budget the offset decays again, one frame per frame so the count
+// Cleanup sees never goes backwards. If the budget can't be reached even at the largest
+// offset, the pressure is suspended for a while rather than evicting what's in use every frame.
+
+#pragma once
+
+#include "Common/CommonTypes.h"
+
+struct TextureConfig;
+
+namespace TextureMemory
+{
+void Add(const TextureConfig& config);
+void Remove(const TextureConfig& config);
+
+// The frame count to pass to TextureCacheBase::Cleanup, aged by the current budget pressure.
+int GetCleanupFrame(int frame_count);
+
+// Called once per frame by the renderer, logs the memory report every so often.
+void EndFrame(u64 frame_number);
+void Shutdown();
+}
@@ -0,0 +1,147 @@
+// Copyright 2018 Dolphin Emulator Project
+// Licensed under GPLv2+
+// Refer to the license.txt file included.
+
+#include "TextureUpload.h"
+
+#include "TextureMemory.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+#include "Common/GL/GLUtil.h"
+#include "Common/Logging/Log.h"
+#include "Common/Timer.h"
+
+#include "VideoBackends/OGL/OGLTexture.h"
+#include "VideoBackends/OGL/StreamBuffer.h"
+
+#include "VideoCommon/VideoConfig.h"
+
+namespace TextureUpload
+{
+static constexpr u32 STAGING_BUFFER_SIZE = 32 * 1024 * 1024;
+// Larger uploads would wrap the ring within a single texture, they go straight from memory.
+static constexpr u32 MAX_STAGED_UPLOAD = STAGING_BUFFER_SIZE / 4;
+// Offsets are kept aligned for the widest texel block.
+static constexpr u32 STAGING_ALIGNMENT = 64;
+// Mapping for longer than this means the ring was full and waited on a fence.
+static constexpr u64 STAGING_WAIT_US = 100;
+static constexpr u64 STATS_INTERVAL = 600;
+
+static std::unique_ptr<OGL::StreamBuffer> s_staging_buffer;
+
+// Per stats interval
+static u64 s_staged_bytes = 0;
+static u64 s_direct_bytes = 0;
+static u32 s_uploads = 0;
+static u32 s_staging_waits = 0;
+static u64 s_upload_us = 0;
+// Worst single frame, the spikes on scene transitions
+static u64 s_frame_upload_us = 0;
+static u64 s_frame_bytes = 0;
+static u64 s_peak_frame_upload_us = 0;
+static u64 s_peak_frame_bytes = 0;
+
+// Counted by TextureMemory for as long as it lives.
+class TrackedTexture : public OGL::OGLTexture
+{
+public:
+  explicit TrackedTexture(const TextureConfig& config) : OGLTexture(config)
+  {
+    TextureMemory::Add(config);
+  }
+  ~TrackedTexture() override { TextureMemory::Remove(m_config); }
+};
+
+class StagedTexture final : public TrackedTexture
+{
+public:
+  explicit StagedTexture(const TextureConfig& config) : TrackedTexture(config) {}
+
+  void Load(u32 level, u32 width, u32 height, u32 row_length, const u8* buffer,
+            size_t buffer_size) override;
+};
+
+void StagedTexture::Load(u32 level, u32 width, u32 height, u32 row_length, const u8* buffer,
+                         size_t buffer_size)
+{
+  const u64 start_time = Common::Timer::GetTimeUs();
+  s_uploads++;
+  s_frame_bytes += buffer_size;
+
+  if (!g_ActiveConfig.bStagedTextureUploads || buffer_size > MAX_STAGED_UPLOAD)
+  {
+    s_direct_bytes += buffer_size;
+    OGLTexture::Load(level, width, height, row_length, buffer, buffer_size);
+    s_frame_upload_us += Common::Timer::GetTimeUs() - start_time;
+    return;
+  }
+
+  if (!s_staging_buffer)
+    s_staging_buffer = OGL::StreamBuffer::Create(GL_PIXEL_UNPACK_BUFFER, STAGING_BUFFER_SIZE);
+
+  const u32 size = static_cast<u32>(buffer_size);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, s_staging_buffer->m_buffer);
+  auto staging = s_staging_buffer->Map(size, STAGING_ALIGNMENT);
+  if (Common::Timer::GetTimeUs() - start_time > STAGING_WAIT_US)
+    s_staging_waits++;
+  std::memcpy(staging.first, buffer, size);
+  s_staging_buffer->Unmap(size);
+
+  // With an unpack buffer bound the data pointer is an offset into it.
+  OGLTexture::Load(level, width, height, row_length,
+                   reinterpret_cast<const u8*>(static_cast<uintptr_t>(staging.second)),
+                   buffer_size);
+  glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+  s_staged_bytes += buffer_size;
+  s_frame_upload_us += Common::Timer::GetTimeUs() - start_time;
+}
+
+std::unique_ptr<AbstractTexture> CreateTexture(const TextureConfig& config)
+{
+  if (config.rendertarget)
+    return std::make_unique<TrackedTexture>(config);
+
+  return std::make_unique<StagedTexture>(config);
+}
+
+void EndFrame(u64 frame_number)
+{
+  s_upload_us += s_frame_upload_us;
+  s_peak_frame_upload_us = std::max(s_peak_frame_upload_us, s_frame_upload_us);
+  s_peak_frame_bytes = std::max(s_peak_frame_bytes, s_frame_bytes);
+  s_frame_upload_us = 0;
+  s_frame_bytes = 0;
+
+  if (frame_number % STATS_INTERVAL != 0)
+    return;
+
+  if (s_uploads)
+  {
+    INFO_LOG(VIDEO, "Texture uploads: %u, %.1f MiB staged, %.1f MiB direct, %u staging waits, "
+                    "%.3f ms/frame (worst frame %.2f ms for %.1f MiB)",
+             s_uploads, s_staged_bytes / 1048576.0, s_direct_bytes / 1048576.0, s_staging_waits,
+             s_upload_us / 1000.0 / STATS_INTERVAL, s_peak_frame_upload_us / 1000.0,
+             s_peak_frame_bytes / 1048576.0);
+  }
+  s_staged_bytes = 0;
+  s_direct_bytes = 0;
+  s_uploads = 0;
+  s_staging_waits = 0;
+  s_upload_us = 0;
+  s_peak_frame_upload_us = 0;
+  s_peak_frame_bytes = 0;
+}
+
+void Shutdown()
+{
+  s_staging_buffer.reset();
+  s_staged_bytes = s_direct_bytes = 0;
+  s_uploads = s_staging_waits = 0;
+  s_upload_us = s_frame_upload_us = s_peak_frame_upload_us = 0;
+  s_frame_bytes = s_peak_frame_bytes = 0;
+}
+}
@@ -0,0 +1,27 @@
+// Copyright 2018 Dolphin Emulator Project
+// Licensed under GPLv2+
+// Refer to the license.txt file included.
+
+// Texture uploads through a staging ring. Decoded texels are copied into a mapped
+// GL_PIXEL_UNPACK_BUFFER and the upload is sourced from there, so the driver transfers them
+// asynchronously instead of copying or waiting on the render thread. The ring is fenced by the
+// stream buffer, a region is only rewritten once the GPU has consumed it.
+
+#pragma once
+
+#include <memory>
+
+#include "Common/CommonTypes.h"
+
+class AbstractTexture;
+struct TextureConfig;
+
+namespace TextureUpload
+{
+// Render targets are never loaded from the CPU, they are only counted by TextureMemory.
+std::unique_ptr<AbstractTexture> CreateTexture(const TextureConfig& config);
+
+// Called once per frame by the renderer, logs the upload counters every so often.
+void EndFrame(u64 frame_number);
+void Shutdown();
+}
@@ -69,6 +69,10 @@ struct VideoConfig final
     u32 iMultisamples;
     bool bSSAA;
     int iEFBScale;
+    //  OE dynamic resolution, iEFBScale follows the GPU frame time between min and max
+    bool bDynamicResolution = false;
+    int iDynamicResolutionMin = 1;
+    int iDynamicResolutionMax = 3;
     bool bForceFiltering;
     int iMaxAnisotropy;
     std::string sPostProcessingShader;
@@ -84,6 +88,8 @@ struct VideoConfig final
     bool bTexFmtOverlayEnable;
     bool bTexFmtOverlayCenter;
     bool bLogRenderTimeToFile;
+    //  OE GPU timestamp queries around the renderer's passes, see GPUTimer.h
+    bool bGPUTimers = false;
     
     // Render
     bool bWireFrame;
@@ -91,6 +97,12 @@ struct VideoConfig final
     
     //  OE render buffer
     int iRenderFBO = 0;
+    //  OE frames the CPU may queue ahead of the GPU before waiting on a fence (1-3)
+    int iPresentQueueDepth = 2;
+    
+    //  OE benchmarking, skip presenting frames and hash every N frames (0 disables hashing)
+    bool bNoPresent = false;
+    int iFrameHashInterval = 0;
     
     // Utility
     bool bDumpTextures;
@@ -108,11 +120,23 @@ struct VideoConfig final
     bool bFreeLook;
     bool bBorderlessFullscreen;
     bool bEnableGPUTextureDecoding;
+    //  OE stream texture uploads through a staging buffer instead of from client memory
+    bool bStagedTextureUploads = true;
+    //  OE texture memory above this ages texture cache entries out faster (0 disables)
+    int iTextureCacheBudgetMB = 1024;
     int iBitrateKbps;
+    //  OE frame dumps, frames queued for the encoder thread and whether a full queue stalls
+    //  the renderer instead of dropping frames
+    int iFrameDumpQueueDepth = 4;
+    bool bFrameDumpBackpressure = false;
     
     // Hacks
     bool bEFBAccessEnable;
+    //  OE EFB peek prefetch, serves peeks from the previous frame's readback
+    bool bEFBAccessPrefetch = false;
     bool bPerfQueriesEnable;
+    //  OE answer perf query reads from the last completed values instead of waiting on the GPU
+    bool bPerfQueriesApproximate = false;
     bool bBBoxEnable;
     bool bBBoxPreferStencilImplementation;  // OpenGL-only, to see how slow it is compared to SSBOs
     bool bForceProgressive;
@@ -124,6 +148,9 @@ struct VideoConfig final
     bool bImmediateXFB;
     bool bCopyEFBScaled;
     int iSafeTextureCache_ColorSamples;
+    //  OE texture hash, log a benchmark at startup and check for collisions (debug builds)
+    bool bTextureHashBenchmark = false;
+    bool bVerifyTextureHashes = false;
     float fAspectRatioHackW, fAspectRatioHackH;
     bool bEnablePixelLighting;
     bool bFastDepthCalc;
@@ -172,6 +199,13 @@ struct VideoConfig final
     int iShaderCompilerThreads;
     int iShaderPrecompilerThreads;
     
+    //  OE adaptive shaders, switches iShaderCompilationMode based on measured stutter
+    bool bAdaptiveShaderCompilation = false;
+    
+    //  OE shader cache bundles, copied into the cache at startup and written at shutdown
+    std::string sShaderCacheBundleImportPath;
+    std::string sShaderCacheBundleExportPath;
+    
     // Static config per API
     // TODO: Move this out of VideoConfig
     struct
@@ -236,10 +270,15 @@ struct VideoConfig final
     bool UsingUberShaders() const;
     u32 GetShaderCompilerThreads() const;
     u32 GetShaderPrecompilerThreads() const;
+    
+    //  OE change generation, bumped by every g_Config writer so the renderer only
+    //  copies to g_ActiveConfig and re-evaluates caches when something changed
+    u32 iGeneration = 0;
+    void MarkChanged() { ++iGeneration; }
 };
 
 extern VideoConfig g_Config;
 extern VideoConfig g_ActiveConfig;
 
-// Called every frame.
+// Called every frame. OE: the renderer skips it unless g_Config.iGeneration moved.
 void UpdateActiveConfig();
@@ -36,6 +36,7 @@
 #include "Common/CPUDetect.h"
 #include "Common/CommonPaths.h"
 #include "Common/CommonTypes.h"
+#include "Common/Config/Config.h"
 #include "Common/FileUtil.h"
 #include "Common/IniFile.h"
 #include "Common/Logging/LogManager.h"
@@ -82,6 +83,7 @@ static Common::Flag s_running{true};
 
 static Common::Flag s_shutdown_requested{false};
 static Common::Flag s_tried_graceful_shutdown{false};
+static bool s_config_callback_registered = false;
 
 DolHost* DolHost::GetInstance()
 {
@@ -127,6 +129,35 @@ void DolHost::Init(std::string supportDirectoryPath, std::string cpath)
     SConfig::GetInstance().m_strVideoBackend = "OGL";
     VideoBackendBase::ActivateBackend(SConfig::GetInstance().m_strVideoBackend);
     
+    //Upstream's g_Config.Refresh doesn't bump the generation, so bump it alongside.
+    //Refreshing here as well keeps it right whichever host job runs last.
+    if (!s_config_callback_registered)
+    {
+        Config::AddConfigChangedCallback([]() {
+            Core::QueueHostJob([]() {
+                g_Config.Refresh();
+                g_Config.MarkChanged();
+            });
+        });
+        s_config_callback_registered = true;
+    }
+    
+    //Use the shader cache bundle installed with the core, if there is one
+    std::string shaderBundlePath = File::GetUserPath(D_USER_IDX) + "ShaderCacheBundle";
+    if (File::IsDirectory(shaderBundlePath))
+    {
+        g_Config.sShaderCacheBundleImportPath = shaderBundlePath;
+        g_Config.MarkChanged();
+    }
+    
+    //Build a bundle from this session's shader cache if the export directory has been created
+    std::string shaderBundleExportPath = File::GetUserPath(D_USER_IDX) + "ShaderCacheBundleExport";
+    if (File::IsDirectory(shaderBundleExportPath))
+    {
+        g_Config.sShaderCacheBundleExportPath = shaderBundleExportPath;
+        g_Config.MarkChanged();
+    }
+    
     //Set the Sound
     SConfig::GetInstance().bDSPHLE = true;
     SConfig::GetInstance().bDSPThread = true;
@@ -272,6 +303,12 @@ void DolHost::SetPresentationFBO(int RenderFBO)
     g_Config.bHiresTextures = false;
     g_Config.bSSAA = false;
     g_Config.iEFBScale = 2;
+    // Dynamic resolution is opt-in, it keeps GPU timestamp queries running every frame. When
+    // enabled it picks between native and 3x starting from the 2x above.
+    g_Config.bDynamicResolution = false;
+    g_Config.iDynamicResolutionMin = 1;
+    g_Config.iDynamicResolutionMax = 3;
+    g_Config.MarkChanged();
 }
 
 void DolHost::SetBackBufferSize(int width, int height) {
@@ -598,7 +635,9 @@ void Host_Message(HostMessageID id) {
         g_Config.aspect_mode = AspectMode::Stretch;
         
         // Core is up,  lets enable Hybric Ubershaders
+        // Adaptive mode moves to specialized shaders once the game stops compiling new ones
         g_Config.iShaderCompilationMode = ShaderCompilationMode::SynchronousUberShaders;
+        g_Config.bAdaptiveShaderCompilation = true;
         //g_Config.bPrecompileUberShaders = true;
         //g_Config.bBackgroundShaderCompiling = true;
         //g_Config.bDisableSpecializedShaders = false;
@@ -606,6 +645,7 @@ void Host_Message(HostMessageID id) {
         //Set the threads to auto (-1)
         g_Config.iShaderCompilerThreads = -1;
         g_Config.iShaderPrecompilerThreads = -1;
+        g_Config.MarkChanged();
         
     }
 }